@@ -25,6 +25,7 @@
 #include "../Savegame/SavedBattleGame.h"
 #include "../Battlescape/TileEngine.h"
 #include "../Battlescape/Pathfinding.h"
+#include "../Battlescape/ThreatMap.h"
 #include "../Engine/RNG.h"
 
 namespace OpenXcom
@@ -35,7 +36,7 @@ namespace OpenXcom
  * @param game pointer to the game.
  * @param unit pointer to the unit.
  */
-AggroBAIState::AggroBAIState(SavedBattleGame *game, BattleUnit *unit) : BattleAIState(game, unit), _aggroTarget(0), _timesNotSeen(0)
+AggroBAIState::AggroBAIState(SavedBattleGame *game, BattleUnit *unit) : BattleAIState(game, unit), _aggroTarget(0), _timesNotSeen(0), _search(SEARCH_NONE), _coverTries(0), _coverPicked(false)
 {
 
 }
@@ -112,11 +113,18 @@ void AggroBAIState::exit()
 
 /**
  * Runs any code the state needs to keep updating every
- * AI cycle.
+ * AI cycle. If the last think stopped in the middle of a search, it goes on with that instead.
  * @param action (possible) AI action to execute after thinking is done.
  */
 void AggroBAIState::think(BattleAction *action)
 {
+	if (_search != SEARCH_NONE)
+	{
+		*action = _searchAction;
+		search(action, false);
+		return;
+	}
+
 	action->type = BA_NONE;
 	action->actor = _unit;
 	/* Aggro is mainly either shooting a target or running towards it (melee).
@@ -247,55 +255,110 @@ void AggroBAIState::think(BattleAction *action)
 
 		if (takeCover)
 		{
-			// the idea is to check within a 5 tile radius for a tile which is not seen by our aggroTarget
+			// the idea is to check within a 5 tile radius for a tile which is not seen by our aggroTarget or other known enemies
 			// if there is no such tile, we run away from the target.
 			// unless we use melee, in which case, try to get within one tile of our target asap.
 			action->type = BA_WALK;
-			int tries = 0;
-			bool coverFound = false;
 			if(action->actor->getMainHandWeapon() && action->actor->getMainHandWeapon()->getRules()->getBattleType() == BT_MELEE )
 			{
-				for (int i = -1; i < 2; i++)
-					for (int j = -1; j < 2; j++)
-					{
-						Position checkPath = Position (_aggroTarget->getPosition().x+i, _aggroTarget->getPosition().y+j, _aggroTarget->getPosition().z);
-						_game->getPathfinding()->calculate(_unit, checkPath);
-						if (_game->getPathfinding()->getStartDirection() != -1)
-							if (_game->getTileEngine()->distance(_unit->getPosition(), checkPath) < _game->getTileEngine()->distance(_unit->getPosition(), action->target))
-								action->target = checkPath;
-						_game->getPathfinding()->abortPath();
-					}
+				_search = SEARCH_MELEE;
 			}
 			else
-			while (tries < 30 && !coverFound)
 			{
-				tries++;
+				// the target is known, even if it's out of sight now
+				_game->getThreatMap()->addWatcher(_aggroTarget);
+				_search = SEARCH_COVER;
+				_coverTries = 0;
+				_coverPicked = false;
+			}
+			search(action, true);
+			return;
+		}
+	}
+
+	action->TU = action->actor->getActionTUs(action->type, action->weapon);
+}
+
+/**
+ * Looks for where to walk to, to get next to the target or into cover. The searches of the
+ * tiles the enemies see and of the tiles the unit can reach are only done when they are needed,
+ * and if the deadline passes the search stops before the next of them, or before the next try,
+ * to go on in the next think. Every think gets at least one step done, however little time is left,
+ * and the random numbers are drawn in the same order however the search is split.
+ * @param action The action to finish.
+ * @param stepped True if this think already did something, so the search may stop before its first step.
+ */
+void AggroBAIState::search(BattleAction *action, bool stepped)
+{
+	if (_search == SEARCH_MELEE)
+	{
+		if (stepped && !_game->getPathfinding()->hasTUMap(_unit, Pathfinding::TU_UNLIMITED) && outOfTime())
+		{
+			_searchAction = *action;
+			return;
+		}
+		for (int i = -1; i < 2; i++)
+			for (int j = -1; j < 2; j++)
+			{
+				Position checkPath = Position (_aggroTarget->getPosition().x+i, _aggroTarget->getPosition().y+j, _aggroTarget->getPosition().z);
+				// one search from the unit answers this for all tiles around the target
+				if (_game->getPathfinding()->isReachable(_unit, checkPath, Pathfinding::TU_UNLIMITED))
+					if (_game->getTileEngine()->distance(_unit->getPosition(), checkPath) < _game->getTileEngine()->distance(_unit->getPosition(), action->target))
+						action->target = checkPath;
+			}
+	}
+	else
+	{
+		bool coverFound = false;
+		while (!coverFound)
+		{
+			if (!_coverPicked)
+			{
+				if (_coverTries == 30)
+					break;
+				if (stepped && outOfTime())
+				{
+					_searchAction = *action;
+					return;
+				}
+				stepped = true;
+				_coverTries++;
 				action->target = _unit->getPosition();
 				action->target.x += RNG::generate(-5,5);
 				action->target.y += RNG::generate(-5,5);
-				if (tries < 20)
-
-					coverFound = !_game->getTileEngine()->visible(_aggroTarget, _game->getTile(action->target));
+				if (_coverTries < 20)
+					_coverPicked = _game->getThreatMap()->getExposure(action->target) == 0;
 				else
-					coverFound = true;
+					_coverPicked = true;
+			}
 
-				if (coverFound)
+			if (_coverPicked)
+			{
+				if (stepped && !_game->getPathfinding()->hasTUMap(_unit, Pathfinding::TU_UNLIMITED) && outOfTime())
 				{
-					// check if we can reach this tile
-					_game->getPathfinding()->calculate(_unit, action->target);
-					if (_game->getPathfinding()->getStartDirection() == -1)
-					{
-						coverFound = false;
-					}
-					_game->getPathfinding()->abortPath();
+					_searchAction = *action;
+					return;
 				}
+				stepped = true;
+				// check if we can reach this tile
+				coverFound = _game->getPathfinding()->isReachable(_unit, action->target, Pathfinding::TU_UNLIMITED);
+				_coverPicked = false;
 			}
 		}
 	}
-
+	_search = SEARCH_NONE;
 	action->TU = action->actor->getActionTUs(action->type, action->weapon);
 }
 
+/**
+ * Checks if the last think stopped in the middle of a search, and has not decided yet.
+ * @return True if the unit is still thinking.
+ */
+bool AggroBAIState::isThinking() const
+{
+	return _search != SEARCH_NONE;
+}
+
 /**
  * Sets the aggro target to be used by the AI.
  * Note that this does not mean the AI will chase the unit, it will just walk towards this position.
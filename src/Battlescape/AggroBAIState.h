@@ -35,9 +35,16 @@ class BattlescapeState;
 class AggroBAIState : public BattleAIState
 {
 protected:
+	/// The search a think stopped in, to go on with in the next one.
+	enum Search { SEARCH_NONE, SEARCH_MELEE, SEARCH_COVER };
 	BattleUnit *_aggroTarget;
 	Position _lastKnownPosition;
 	int _timesNotSeen;
+	Search _search;
+	BattleAction _searchAction;
+	int _coverTries;
+	bool _coverPicked;
+	void search(BattleAction *action, bool stepped);
 public:
 	/// Creates a new AggroBAIState linked to the game and a certain unit.
 	AggroBAIState(SavedBattleGame *game, BattleUnit *unit);
@@ -53,6 +60,8 @@ public:
 	void exit();
 	/// Runs state functionality every AI cycle.
 	void think(BattleAction *action);
+	/// Checks if the last think stopped in the middle of a search.
+	bool isThinking() const;
 	/// Sets aggro target, triggered by reaction fire.
 	void setAggroTarget(BattleUnit *unit);
 	/// Get the aggro target, for savegame
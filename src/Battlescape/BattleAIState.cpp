@@ -17,6 +17,7 @@
  * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "BattleAIState.h"
+#include <SDL.h>
 
 namespace OpenXcom
 {
@@ -24,7 +25,7 @@ namespace OpenXcom
 /**
  * Sets up a BattleAIState.
  */
-BattleAIState::BattleAIState(SavedBattleGame *game, BattleUnit *unit) : _game(game), _unit(unit)
+BattleAIState::BattleAIState(SavedBattleGame *game, BattleUnit *unit) : _game(game), _unit(unit), _deadline(0)
 {
 
 }
@@ -80,4 +81,32 @@ void BattleAIState::think(BattleAction *action)
 
 }
 
+/**
+ * Checks if the last think stopped because it ran out of time,
+ * so the next think goes on from where it stopped instead of deciding.
+ * @return True if the state is still thinking.
+ */
+bool BattleAIState::isThinking() const
+{
+	return false;
+}
+
+/**
+ * Sets the time thinking has to stop by, so a long think can be spread over frames.
+ * @param deadline SDL ticks to stop by, 0 to think until done.
+ */
+void BattleAIState::setDeadline(Uint32 deadline)
+{
+	_deadline = deadline;
+}
+
+/**
+ * Checks if the deadline has passed.
+ * @return True if thinking has to stop for this frame.
+ */
+bool BattleAIState::outOfTime() const
+{
+	return _deadline != 0 && SDL_GetTicks() >= _deadline;
+}
+
 }
@@ -37,6 +37,9 @@ class BattleAIState
 protected:
 	SavedBattleGame *_game;
 	BattleUnit *_unit;
+	Uint32 _deadline;
+	/// Checks if thinking has to stop for this frame.
+	bool outOfTime() const;
 public:
 	/// Creates a new BattleAIState linked to the game and a certain unit.
 	BattleAIState(SavedBattleGame *game, BattleUnit *unit);
@@ -52,6 +55,10 @@ public:
 	virtual void exit();
 	/// Runs state functionality every AI cycle.
 	virtual void think(BattleAction *action);
+	/// Checks if the last think stopped before making a decision.
+	virtual bool isThinking() const;
+	/// Sets the time thinking has to stop by.
+	void setDeadline(Uint32 deadline);
 };
 
 }
@@ -18,6 +18,7 @@
  */
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <algorithm>
 #include <sstream>
 #include "BattlescapeGame.h"
 #include "BattlescapeState.h"
@@ -67,6 +68,7 @@
 #include "../Ruleset/RuleItem.h"
 #include "../Ruleset/Armor.h"
 #include "../Engine/Options.h"
+#include "../Engine/Logger.h"
 #include "WarningMessage.h"
 #include "BattlescapeOptionsState.h"
 #include "DebriefingState.h"
@@ -89,6 +91,13 @@ BattlescapeGame::BattlescapeGame(SavedBattleGame *save, BattlescapeState *parent
 	_debugPlay = false;
 	_playerPanicHandled = true;
 	_AIActionCounter = 0;
+	_AITurnTime = 0;
+	_AIFrameTime = 0;
+	_AIFrames = 0;
+	for (int i = 0; i < PhaseTimer::PHASES; ++i)
+	{
+		_AIPhaseTime[i] = PhaseTimer::getTime((PhaseTimer::Phase)i);
+	}
 	_currentAction.actor = 0;
 
 	checkForCasualties(0, 0, true);
@@ -129,7 +138,7 @@ void BattlescapeGame::think()
 					{
 						if (!_save->getDebugMode())
 						{
-							statePushBack(0); // end AI turn
+							endAITurn();
 						}
 						else
 						{
@@ -163,10 +172,15 @@ void BattlescapeGame::init()
 
 /**
  * Handles the processing of the AI states of a unit.
+ * A decision is made in two slices: first the searches it needs, then the decision itself.
+ * If the searches use up the frame budget, the decision waits for the next frame so the
+ * screen is drawn in between. Nothing changes on the battlescape while it waits, and the
+ * searches are only kept to be looked up, so the decision is the same either way.
  * @param unit Pointer to an unit.
  */
 void BattlescapeGame::handleAI(BattleUnit *unit)
 {
+	Uint32 start = SDL_GetTicks();
 	BattleAIState *ai = unit->getCurrentAIState();
 	if (!ai)
 	{
@@ -175,12 +189,22 @@ void BattlescapeGame::handleAI(BattleUnit *unit)
 		ai = unit->getCurrentAIState();
 	}
 
-	_AIActionCounter++;
-
 	AggroBAIState *aggro = dynamic_cast<AggroBAIState*>(ai);
 
+	// a long think stops when the frame is used up, and goes on in the next frame
+	ai->setDeadline(start + Options::getInt("battleAIFrameBudget"));
 	BattleAction action;
 	unit->think(&action);
+	if (unit->getCurrentAIState()->isThinking())
+	{
+		Uint32 time = SDL_GetTicks() - start;
+		_AITurnTime += time;
+		_AIFrameTime = std::max(_AIFrameTime, time);
+		_AIFrames++;
+		return;
+	}
+
+	_AIActionCounter++;
 	if (action.type == BA_WALK)
 	{
 		if (unit->getType() == "CHRYSSALID" && aggro)
@@ -189,7 +213,11 @@ void BattlescapeGame::handleAI(BattleUnit *unit)
 			// todo: put the aggro sound in the ruleset
 			getResourcePack()->getSoundSet("BATTLE.CAT")->getSound(49)->play();
 		}
- 		_save->getPathfinding()->calculate(action.actor, action.target);
+		// patrols walk the same legs between nodes over and over
+		if (dynamic_cast<PatrolBAIState*>(unit->getCurrentAIState()))
+			_save->getPathfinding()->calculateRoute(action.actor, action.target);
+		else
+			_save->getPathfinding()->calculate(action.actor, action.target);
 		statePushBack(new UnitWalkBState(this, action));
 	}
 
@@ -211,7 +239,7 @@ void BattlescapeGame::handleAI(BattleUnit *unit)
 		{
 			if (!_save->getDebugMode())
 			{
-				statePushBack(0); // end AI turn
+				endAITurn();
 			}
 			else
 			{
@@ -224,6 +252,33 @@ void BattlescapeGame::handleAI(BattleUnit *unit)
 			getMap()->getCamera()->centerOnPosition(_save->getSelectedUnit()->getPosition());
 		}
 	}
+
+	Uint32 time = SDL_GetTicks() - start;
+	_AITurnTime += time;
+	_AIFrameTime = std::max(_AIFrameTime, time);
+	_AIFrames++;
+}
+
+/**
+ * Ends the AI turn, and reports how long the AI took to think in it, the time spent in
+ * the costly calculations of the battlescape since the last AI turn ended, and a hash of
+ * the state of the units to compare runs of the same save with.
+ */
+void BattlescapeGame::endAITurn()
+{
+	Log(LOG_INFO) << "AI turn " << _save->getTurn() << ": " << _AITurnTime << " ms thinking in " << _AIFrames << " frames, longest frame " << _AIFrameTime << " ms";
+	std::ostringstream phases;
+	for (int i = 0; i < PhaseTimer::PHASES; ++i)
+	{
+		PhaseTimer::Phase phase = (PhaseTimer::Phase)i;
+		phases << (i ? ", " : "") << PhaseTimer::getName(phase) << " " << (int)(PhaseTimer::getTime(phase) - _AIPhaseTime[i]) << " ms";
+		_AIPhaseTime[i] = PhaseTimer::getTime(phase);
+	}
+	Log(LOG_INFO) << "AI turn " << _save->getTurn() << ": " << phases.str() << ", state hash " << std::hex << _save->getStateHash() << std::dec;
+	_AITurnTime = 0;
+	_AIFrameTime = 0;
+	_AIFrames = 0;
+	statePushBack(0); // end AI turn
 }
 
 /**
@@ -718,7 +773,7 @@ void BattlescapeGame::popState()
 					{
 						if (!_save->getDebugMode())
 						{
-							statePushBack(0); // end AI turn
+							endAITurn();
 						}
 						else
 						{
@@ -1209,7 +1264,7 @@ void BattlescapeGame::dropItem(const Position &position, BattleItem *item, bool
 
 	if (item->getRules()->getBattleType() == BT_FLARE)
 	{
-		getTileEngine()->calculateTerrainLighting();
+		getTileEngine()->calculateTerrainLighting(p.x, p.y, p.x, p.y);
 	}
 
 }
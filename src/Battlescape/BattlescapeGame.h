@@ -20,6 +20,7 @@
 #define OPENXCOM_BATTLESCAPEGAME_H
 
 #include "Position.h"
+#include "PhaseTimer.h"
 #include <SDL.h>
 #include <string>
 #include <list>
@@ -69,12 +70,18 @@ private:
 	bool _debugPlay, _playerPanicHandled;
 	int _AIActionCounter;
 	BattleAction _currentAction;
+	/// Time spent thinking in this AI turn, the frames it took and the longest of them, in milliseconds.
+	Uint32 _AITurnTime, _AIFrameTime;
+	int _AIFrames;
+	/// Time spent in each phase when the last AI turn ended, in milliseconds.
+	double _AIPhaseTime[PhaseTimer::PHASES];
 
 	void selectNextPlayerUnit(bool checkReselect);
 	void endTurn();
 	bool handlePanickingPlayer();
 	bool handlePanickingUnit(BattleUnit *unit);
 	bool noActionsPending(BattleUnit *bu);
+	void endAITurn();
 	std::vector<InfoboxOKState*> _infoboxQueue;
 	void showInfoBoxQueue();
 public:
@@ -0,0 +1,467 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include "ClusterGraph.h"
+#include "Pathfinding.h"
+#include "../Savegame/SavedBattleGame.h"
+
+namespace OpenXcom
+{
+
+/**
+ * Sets up a cluster graph. Nothing is worked out until a path is asked for.
+ * @param save Pointer to the battlescape.
+ * @param pathfinding Pointer to the pathfinding, for the TU costs of moves.
+ */
+ClusterGraph::ClusterGraph(SavedBattleGame *save, Pathfinding *pathfinding) : _save(save), _pathfinding(pathfinding), _search(0), _moveCost(4)
+{
+	_clustersX = (_save->getWidth() + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	_clustersY = (_save->getLength() + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	_clusterTiles = CLUSTER_SIZE * CLUSTER_SIZE * _save->getHeight();
+	for (int cy = 0; cy < _clustersY; ++cy)
+	{
+		for (int cx = 0; cx < _clustersX; ++cx)
+		{
+			Cluster cluster;
+			cluster.x0 = cx * CLUSTER_SIZE;
+			cluster.y0 = cy * CLUSTER_SIZE;
+			cluster.x1 = std::min(cluster.x0 + CLUSTER_SIZE, _save->getWidth()) - 1;
+			cluster.y1 = std::min(cluster.y0 + CLUSTER_SIZE, _save->getLength()) - 1;
+			cluster.exitsKnown = false;
+			cluster.entrancesKnown = false;
+			_clusters.push_back(cluster);
+		}
+	}
+	int size = _save->getWidth() * _save->getLength() * _save->getHeight();
+	_entranceIndex.resize(size, -1);
+	_searched.resize(size, 0);
+	_checked.resize(size);
+	_cost.resize(size);
+	_previous.resize(size);
+	_direction.resize(size);
+}
+
+/**
+ * Deletes the cluster graph.
+ */
+ClusterGraph::~ClusterGraph()
+{
+}
+
+/**
+ * Gets the cluster a position is in.
+ * @param position The position.
+ * @return Index of the cluster, or -1 if the position is off the map.
+ */
+int ClusterGraph::getCluster(const Position &position) const
+{
+	if (position.x < 0 || position.y < 0 || position.z < 0
+		|| position.x >= _save->getWidth() || position.y >= _save->getLength() || position.z >= _save->getHeight())
+		return -1;
+	return position.x / CLUSTER_SIZE + (position.y / CLUSTER_SIZE) * _clustersX;
+}
+
+/**
+ * Gets the index of a position among the tiles of its cluster.
+ * @param cluster The cluster of the position.
+ * @param position The position.
+ * @return Index in the cost table of the cluster.
+ */
+int ClusterGraph::getClusterTile(const Cluster &cluster, const Position &position) const
+{
+	return (position.z * CLUSTER_SIZE + position.y - cluster.y0) * CLUSTER_SIZE + position.x - cluster.x0;
+}
+
+/**
+ * Keeps track of the cheapest move across a tile, walking on any floor costs 4 TU
+ * but the terrain could have cheaper ones.
+ * @param direction The direction of the move.
+ * @param cost The TU cost of the move.
+ */
+void ClusterGraph::addMoveCost(int direction, int cost)
+{
+	if (direction < 8 && cost < _moveCost)
+		_moveCost = cost;
+}
+
+/**
+ * Finds the moves from the edge of a cluster into the clusters around it.
+ * @param unit The moving unit.
+ * @param cluster Index of the cluster.
+ */
+void ClusterGraph::findExits(BattleUnit *unit, int cluster)
+{
+	Cluster &c = _clusters[cluster];
+	c.exits.clear();
+	for (int z = 0; z < _save->getHeight(); ++z)
+	{
+		for (int y = c.y0; y <= c.y1; ++y)
+		{
+			for (int x = c.x0; x <= c.x1; ++x)
+			{
+				// moves go one column at most, so only the edge can leave
+				if (x != c.x0 && x != c.x1 && y != c.y0 && y != c.y1)
+					continue;
+				Position pos(x, y, z);
+				for (int direction = 0; direction < 8; ++direction)
+				{
+					Position next;
+					int cost = _pathfinding->getTerrainTUCost(pos, direction, &next, unit);
+					if (cost == 255)
+						continue;
+					addMoveCost(direction, cost);
+					int nextCluster = getCluster(next);
+					if (nextCluster == -1 || nextCluster == cluster)
+						continue;
+					Exit exit;
+					exit.to = _save->getTileIndex(next);
+					exit.cost = cost;
+					exit.direction = direction;
+					c.exits.push_back(std::make_pair(_save->getTileIndex(pos), exit));
+				}
+			}
+		}
+	}
+	c.exitsKnown = true;
+}
+
+/**
+ * Finds the entrances of a cluster: the tiles its exits start from, and
+ * the tiles the exits of the clusters around it go to.
+ * Entrances that were already there keep their costs.
+ * @param unit The moving unit.
+ * @param cluster Index of the cluster.
+ */
+void ClusterGraph::findEntrances(BattleUnit *unit, int cluster)
+{
+	int cx = cluster % _clustersX, cy = cluster / _clustersX;
+	std::vector<int> tiles;
+	for (int y = std::max(0, cy - 1); y <= std::min(_clustersY - 1, cy + 1); ++y)
+	{
+		for (int x = std::max(0, cx - 1); x <= std::min(_clustersX - 1, cx + 1); ++x)
+		{
+			int neighbour = x + y * _clustersX;
+			if (!_clusters[neighbour].exitsKnown)
+				findExits(unit, neighbour);
+			const std::vector<std::pair<int, Exit> > &exits = _clusters[neighbour].exits;
+			for (std::vector<std::pair<int, Exit> >::const_iterator i = exits.begin(); i != exits.end(); ++i)
+			{
+				if (neighbour == cluster)
+				{
+					tiles.push_back(i->first);
+				}
+				else
+				{
+					Position to;
+					_save->getTileCoords(i->second.to, &to.x, &to.y, &to.z);
+					if (getCluster(to) == cluster)
+						tiles.push_back(i->second.to);
+				}
+			}
+		}
+	}
+	std::sort(tiles.begin(), tiles.end());
+	tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+	Cluster &c = _clusters[cluster];
+	std::vector<Entrance> old;
+	old.swap(c.entrances);
+	for (std::vector<Entrance>::iterator i = old.begin(); i != old.end(); ++i)
+	{
+		_entranceIndex[i->tile] = -1;
+	}
+	c.entrances.resize(tiles.size());
+	for (size_t i = 0; i < tiles.size(); ++i)
+	{
+		c.entrances[i].tile = tiles[i];
+		_entranceIndex[tiles[i]] = i;
+	}
+	// the terrain inside the cluster didn't change, or the old entrances would be gone
+	for (std::vector<Entrance>::iterator i = old.begin(); i != old.end(); ++i)
+	{
+		if (_entranceIndex[i->tile] != -1)
+			c.entrances[_entranceIndex[i->tile]].costs.swap(i->costs);
+	}
+	for (std::vector<std::pair<int, Exit> >::const_iterator i = c.exits.begin(); i != c.exits.end(); ++i)
+	{
+		c.entrances[_entranceIndex[i->first]].exits.push_back(i->second);
+	}
+	c.entrancesKnown = true;
+}
+
+/**
+ * Gets the TU costs from a tile to every tile of its cluster.
+ * They are kept for entrances, and worked out again for any other tile.
+ * @param unit The moving unit.
+ * @param tile Index of the tile.
+ * @return The cost table.
+ */
+const std::vector<int> &ClusterGraph::getCosts(BattleUnit *unit, int tile)
+{
+	Position pos;
+	_save->getTileCoords(tile, &pos.x, &pos.y, &pos.z);
+	Cluster &c = _clusters[getCluster(pos)];
+	if (!c.entrancesKnown)
+		findEntrances(unit, getCluster(pos));
+	if (_entranceIndex[tile] == -1)
+	{
+		searchCluster(unit, tile, &_startCosts, 0);
+		return _startCosts;
+	}
+	Entrance &entrance = c.entrances[_entranceIndex[tile]];
+	if (entrance.costs.empty())
+		searchCluster(unit, tile, &entrance.costs, 0);
+	return entrance.costs;
+}
+
+/**
+ * Works out the cheapest paths from a tile to every tile of its cluster, without leaving it.
+ * @param unit The moving unit.
+ * @param tile Index of the tile.
+ * @param costs Gets the TU cost to each tile of the cluster, -1 where it can't go.
+ * @param previous If set, gets the tile before each tile of the cluster times 10, plus the direction from it.
+ */
+void ClusterGraph::searchCluster(BattleUnit *unit, int tile, std::vector<int> *costs, std::vector<int> *previous)
+{
+	Position start;
+	_save->getTileCoords(tile, &start.x, &start.y, &start.z);
+	int cluster = getCluster(start);
+	const Cluster &c = _clusters[cluster];
+	costs->assign(_clusterTiles, -1);
+	if (previous)
+		previous->assign(_clusterTiles, -1);
+
+	std::vector<std::pair<int, int> > open;
+	(*costs)[getClusterTile(c, start)] = 0;
+	open.push_back(std::make_pair(0, tile));
+	while (!open.empty())
+	{
+		std::pop_heap(open.begin(), open.end(), std::greater<std::pair<int, int> >());
+		int cost = open.back().first;
+		Position pos;
+		_save->getTileCoords(open.back().second, &pos.x, &pos.y, &pos.z);
+		open.pop_back();
+		int current = getClusterTile(c, pos);
+		if (cost > (*costs)[current])
+			continue;
+		for (int direction = 0; direction < 10; ++direction)
+		{
+			Position next;
+			int tuCost = _pathfinding->getTerrainTUCost(pos, direction, &next, unit);
+			if (tuCost == 255 || getCluster(next) != cluster)
+				continue;
+			addMoveCost(direction, tuCost);
+			int index = getClusterTile(c, next);
+			if ((*costs)[index] == -1 || (*costs)[index] > cost + tuCost)
+			{
+				(*costs)[index] = cost + tuCost;
+				if (previous)
+					(*previous)[index] = current * 10 + direction;
+				open.push_back(std::make_pair(cost + tuCost, _save->getTileIndex(next)));
+				std::push_heap(open.begin(), open.end(), std::greater<std::pair<int, int> >());
+			}
+		}
+	}
+}
+
+/**
+ * Checks if two positions are far enough apart that planning through clusters pays off,
+ * which is when there is at least one cluster between them.
+ * @param start The position to start from.
+ * @param end The position to go to.
+ * @return True if the positions are far apart.
+ */
+bool ClusterGraph::isFar(const Position &start, const Position &end) const
+{
+	return std::abs(start.x / CLUSTER_SIZE - end.x / CLUSTER_SIZE) > 1 || std::abs(start.y / CLUSTER_SIZE - end.y / CLUSTER_SIZE) > 1;
+}
+
+/**
+ * Reaches a tile in the abstract search, if it's cheaper than before.
+ * @param tile Index of the tile.
+ * @param cost The total TU cost to get there.
+ * @param previous The tile it's reached from.
+ * @param direction The direction of the move from the previous tile, or -1 for a path inside a cluster.
+ * @param end The position the search goes to.
+ */
+void ClusterGraph::connect(int tile, int cost, int previous, int direction, const Position &end)
+{
+	if (_searched[tile] == _search && (_checked[tile] || _cost[tile] <= cost))
+		return;
+	_searched[tile] = _search;
+	_checked[tile] = false;
+	_cost[tile] = cost;
+	_previous[tile] = previous;
+	_direction[tile] = direction;
+	// every move goes at most one tile across, while stairs and falls change level for nothing extra
+	Position pos;
+	_save->getTileCoords(tile, &pos.x, &pos.y, &pos.z);
+	int guess = _moveCost * std::max(std::abs(end.x - pos.x), std::abs(end.y - pos.y));
+	_open.push_back(std::make_pair(cost + guess, tile));
+	std::push_heap(_open.begin(), _open.end(), std::greater<std::pair<int, int> >());
+}
+
+/**
+ * Finds the cheapest path between two positions through the entrances of the clusters,
+ * then turns it into moves by finding the paths inside each cluster again.
+ * Every way of crossing between clusters is in the graph and the paths inside clusters are exact.
+ * The cost left is guessed as the cheapest move across a tile (4 TU, walking on a floor) per tile
+ * across. That never overestimates, and it grows no faster along a path than the path costs, so no
+ * tile needs to be checked twice and the path found is the cheapest on the map. If the graph comes
+ * across a cheaper move while searching, the guesses were too high and the search is done again.
+ * The path can be cheaper than the one of Pathfinding::aStarPath, whose guess also counts levels.
+ * Units are not taken into account.
+ * @param unit The moving unit.
+ * @param start The position to start from.
+ * @param end The position to go to.
+ * @param path Gets the directions of the moves, first move first.
+ * @return False if there is no path, even without units in the way.
+ */
+bool ClusterGraph::findPath(BattleUnit *unit, const Position &start, const Position &end, std::vector<int> *path)
+{
+	int startTile = _save->getTileIndex(start);
+	int endTile = _save->getTileIndex(end);
+	int endCluster = getCluster(end);
+	int moveCost = _moveCost;
+	if (++_search == 0)
+	{
+		std::fill(_searched.begin(), _searched.end(), 0);
+		_search = 1;
+	}
+	_open.clear();
+	connect(startTile, 0, -1, -1, end);
+
+	while (!_open.empty())
+	{
+		if (_moveCost != moveCost)
+		{
+			return findPath(unit, start, end, path);
+		}
+		std::pop_heap(_open.begin(), _open.end(), std::greater<std::pair<int, int> >());
+		int current = _open.back().second;
+		_open.pop_back();
+		if (_checked[current])
+			continue;
+		_checked[current] = true;
+
+		if (current == endTile)
+		{
+			std::vector<int> tiles;
+			for (int tile = endTile; tile != -1; tile = _previous[tile])
+			{
+				tiles.push_back(tile);
+			}
+			path->clear();
+			for (size_t i = tiles.size() - 1; i > 0; --i)
+			{
+				if (_direction[tiles[i - 1]] != -1)
+					path->push_back(_direction[tiles[i - 1]]);
+				else
+					refinePath(unit, tiles[i], tiles[i - 1], path);
+			}
+			return true;
+		}
+
+		Position pos;
+		_save->getTileCoords(current, &pos.x, &pos.y, &pos.z);
+		int cluster = getCluster(pos);
+		const std::vector<int> &costs = getCosts(unit, current);
+		const Cluster &c = _clusters[cluster];
+		int cost = _cost[current];
+
+		// paths inside the cluster, to its other entrances and maybe the end
+		for (std::vector<Entrance>::const_iterator i = c.entrances.begin(); i != c.entrances.end(); ++i)
+		{
+			Position to;
+			_save->getTileCoords(i->tile, &to.x, &to.y, &to.z);
+			int tuCost = costs[getClusterTile(c, to)];
+			if (i->tile != current && tuCost != -1)
+				connect(i->tile, cost + tuCost, current, -1, end);
+		}
+		if (cluster == endCluster && costs[getClusterTile(c, end)] != -1)
+		{
+			connect(endTile, cost + costs[getClusterTile(c, end)], current, -1, end);
+		}
+
+		// moves into the clusters around
+		if (_entranceIndex[current] != -1)
+		{
+			const std::vector<Exit> &exits = c.entrances[_entranceIndex[current]].exits;
+			for (std::vector<Exit>::const_iterator i = exits.begin(); i != exits.end(); ++i)
+			{
+				connect(i->to, cost + i->cost, current, i->direction, end);
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Adds the moves of the cheapest path between two tiles of the same cluster to a path.
+ * @param unit The moving unit.
+ * @param from Index of the tile to start from.
+ * @param to Index of the tile to go to.
+ * @param path The path to add to.
+ */
+void ClusterGraph::refinePath(BattleUnit *unit, int from, int to, std::vector<int> *path)
+{
+	std::vector<int> costs, previous;
+	searchCluster(unit, from, &costs, &previous);
+	Position pos;
+	_save->getTileCoords(to, &pos.x, &pos.y, &pos.z);
+	std::vector<int> directions;
+	for (int tile = getClusterTile(_clusters[getCluster(pos)], pos); previous[tile] != -1; tile = previous[tile] / 10)
+	{
+		directions.push_back(previous[tile] % 10);
+	}
+	path->insert(path->end(), directions.rbegin(), directions.rend());
+}
+
+/**
+ * Marks the clusters whose moves could go over changed terrain as out of date,
+ * so they are worked out again when a path needs them.
+ * The entrances of the clusters around them are found again too.
+ * @param position The position of the change.
+ * @param radius How far around the position moves could be changed.
+ */
+void ClusterGraph::invalidate(const Position &position, int radius)
+{
+	int x0 = std::max(0, position.x - radius) / CLUSTER_SIZE, x1 = std::min(_clustersX - 1, (position.x + radius) / CLUSTER_SIZE);
+	int y0 = std::max(0, position.y - radius) / CLUSTER_SIZE, y1 = std::min(_clustersY - 1, (position.y + radius) / CLUSTER_SIZE);
+	for (int cy = std::max(0, y0 - 1); cy <= std::min(_clustersY - 1, y1 + 1); ++cy)
+	{
+		for (int cx = std::max(0, x0 - 1); cx <= std::min(_clustersX - 1, x1 + 1); ++cx)
+		{
+			Cluster &c = _clusters[cx + cy * _clustersX];
+			c.entrancesKnown = false;
+			if (cx < x0 || cx > x1 || cy < y0 || cy > y1)
+				continue;
+			c.exitsKnown = false;
+			for (std::vector<Entrance>::iterator i = c.entrances.begin(); i != c.entrances.end(); ++i)
+			{
+				_entranceIndex[i->tile] = -1;
+			}
+			c.entrances.clear();
+		}
+	}
+}
+
+}
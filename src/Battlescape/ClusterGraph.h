@@ -0,0 +1,110 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_CLUSTERGRAPH_H
+#define OPENXCOM_CLUSTERGRAPH_H
+
+#include <vector>
+#include <SDL.h>
+#include "Position.h"
+
+namespace OpenXcom
+{
+
+class SavedBattleGame;
+class Pathfinding;
+class BattleUnit;
+
+/**
+ * An abstract graph of the battlescape map for planning long paths.
+ * The map is cut into clusters of 10x10 columns, the size of a map block, going over all levels.
+ * Every tile where a move crosses into another cluster is an entrance, and entrances are joined by
+ * the crossing moves and by the cheapest paths between them inside their cluster.
+ * Since no entrance is left out, the cheapest path through the graph is the cheapest path on the map,
+ * and the search through the graph finds it (see findPath).
+ * The graph only knows the terrain: units are left for the caller to check.
+ * Any terrain change marks the clusters around it as out of date, and that includes every door
+ * that opens or closes, so their entrances and paths are worked out again when next needed.
+ */
+class ClusterGraph
+{
+private:
+	static const int CLUSTER_SIZE = 10;
+	/// A move from an entrance into another cluster.
+	struct Exit
+	{
+		int to, cost, direction;
+	};
+	/// A tile where paths enter or leave a cluster.
+	struct Entrance
+	{
+		int tile;
+		std::vector<Exit> exits;
+		/// TU cost to every tile of the cluster, -1 where it can't go, worked out when first needed.
+		std::vector<int> costs;
+	};
+	struct Cluster
+	{
+		int x0, y0, x1, y1;
+		bool exitsKnown, entrancesKnown;
+		/// The tiles on the edge of the cluster and their moves out of it.
+		std::vector<std::pair<int, Exit> > exits;
+		std::vector<Entrance> entrances;
+	};
+	SavedBattleGame *_save;
+	Pathfinding *_pathfinding;
+	int _clustersX, _clustersY, _clusterTiles;
+	std::vector<Cluster> _clusters;
+	/// Entrance of each tile in its cluster, or -1.
+	std::vector<int> _entranceIndex;
+	/// Abstract search information for each tile.
+	unsigned int _search;
+	std::vector<unsigned int> _searched;
+	std::vector<bool> _checked;
+	std::vector<int> _cost, _previous;
+	std::vector<Sint8> _direction;
+	/// Open tiles of the abstract search, as a heap of cost guesses.
+	std::vector<std::pair<int, int> > _open;
+	std::vector<int> _startCosts;
+	/// The cheapest move across a tile seen so far, for guessing the cost left.
+	int _moveCost;
+	void addMoveCost(int direction, int cost);
+	int getCluster(const Position &position) const;
+	int getClusterTile(const Cluster &cluster, const Position &position) const;
+	void findExits(BattleUnit *unit, int cluster);
+	void findEntrances(BattleUnit *unit, int cluster);
+	const std::vector<int> &getCosts(BattleUnit *unit, int tile);
+	void searchCluster(BattleUnit *unit, int tile, std::vector<int> *costs, std::vector<int> *previous);
+	void connect(int tile, int cost, int previous, int direction, const Position &end);
+	void refinePath(BattleUnit *unit, int from, int to, std::vector<int> *path);
+public:
+	/// Creates a cluster graph of the map.
+	ClusterGraph(SavedBattleGame *save, Pathfinding *pathfinding);
+	/// Cleans up the cluster graph.
+	~ClusterGraph();
+	/// Checks if two positions are far enough apart to plan through clusters.
+	bool isFar(const Position &start, const Position &end) const;
+	/// Finds the cheapest path between two positions, as if there were no units.
+	bool findPath(BattleUnit *unit, const Position &start, const Position &end, std::vector<int> *path);
+	/// Marks the clusters around changed terrain as out of date.
+	void invalidate(const Position &position, int radius);
+};
+
+}
+
+#endif
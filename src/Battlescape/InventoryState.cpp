@@ -227,8 +227,9 @@ void InventoryState::btnOkClick(Action *action)
 		saveEquipmentLayout();
 		_battleGame->resetUnitTiles();
 	}
+	Position pos = _battleGame->getSelectedUnit()->getPosition();
 	_battleGame->getTileEngine()->applyItemGravity(_battleGame->getSelectedUnit()->getTile());
-	_battleGame->getTileEngine()->calculateTerrainLighting(); // dropping/picking up flares
+	_battleGame->getTileEngine()->calculateTerrainLighting(pos.x, pos.y, pos.x, pos.y); // dropping/picking up flares
 }
 
 /**
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include "LightField.h"
+#include "Position.h"
+#include "../Savegame/SavedBattleGame.h"
+#include "../Savegame/Tile.h"
+
+namespace OpenXcom
+{
+
+/**
+ * Sets up a light field without any light.
+ * @param save Pointer to SavedBattleGame object.
+ */
+LightField::LightField(SavedBattleGame *save) : _save(save)
+{
+	for (int layer = 0; layer < Tile::LIGHTLAYERS; ++layer)
+	{
+		_light[layer].resize(_save->getWidth() * _save->getLength(), 0);
+	}
+}
+
+/**
+ * Deletes the light field.
+ */
+LightField::~LightField()
+{
+
+}
+
+/**
+ * Gets the circular light pattern of a light source, starting from the center
+ * and loosing power with distance travelled. Only points that get lit are included.
+ * @param power The power of the light source.
+ * @return The points of the pattern.
+ */
+const std::vector<LightStencilPoint> &LightField::getStencil(int power)
+{
+	if (power >= (int)_stencils.size())
+	{
+		_stencils.resize(power + 1);
+	}
+	std::vector<LightStencilPoint> &stencil = _stencils[power];
+	if (stencil.empty())
+	{
+		for (int x = -power; x <= power; ++x)
+		{
+			for (int y = -power; y <= power; ++y)
+			{
+				int distance = int(floor(sqrt(float(x*x + y*y)) + 0.5));
+				if (power - distance > 0)
+				{
+					LightStencilPoint point = { x, y, std::min(power - distance, 255) };
+					stencil.push_back(point);
+				}
+			}
+		}
+	}
+	return stencil;
+}
+
+/**
+ * Recalculates the light in an area from all sources that reach it,
+ * and updates the tiles of the columns whose light changed.
+ * @param layer The light layer.
+ * @param x0 Left edge of the area.
+ * @param y0 Top edge of the area.
+ * @param x1 Right edge of the area.
+ * @param y1 Bottom edge of the area.
+ */
+void LightField::recalculate(int layer, int x0, int y0, int x1, int y1)
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, _save->getWidth() - 1);
+	y1 = std::min(y1, _save->getLength() - 1);
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	int width = x1 - x0 + 1;
+	std::vector<Uint8> area(width * (y1 - y0 + 1), 0);
+
+	for (std::vector<LightSource>::const_iterator i = _sources[layer].begin(); i != _sources[layer].end(); ++i)
+	{
+		if (i->power <= 0 || i->x + i->power < x0 || i->x - i->power > x1 || i->y + i->power < y0 || i->y - i->power > y1)
+			continue;
+
+		const std::vector<LightStencilPoint> &stencil = getStencil(i->power);
+		for (std::vector<LightStencilPoint>::const_iterator j = stencil.begin(); j != stencil.end(); ++j)
+		{
+			int x = i->x + j->x;
+			int y = i->y + j->y;
+			if (x < x0 || x > x1 || y < y0 || y > y1)
+				continue;
+			Uint8 &light = area[(y - y0) * width + (x - x0)];
+			if (light < j->light)
+				light = j->light;
+		}
+	}
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			Uint8 light = area[(y - y0) * width + (x - x0)];
+			Uint8 &current = _light[layer][y * _save->getWidth() + x];
+			if (current != light)
+			{
+				current = light;
+				for (int z = 0; z < _save->getHeight(); ++z)
+				{
+					_save->getTile(Position(x, y, z))->setLight(light, layer);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Replaces the light sources of a layer. Only the areas of sources that were
+ * added or removed since the last call are recalculated.
+ * @param layer The light layer.
+ * @param sources The new light sources.
+ */
+void LightField::setSources(int layer, std::vector<LightSource> sources)
+{
+	std::sort(sources.begin(), sources.end());
+
+	std::vector<LightSource> changed;
+	std::set_symmetric_difference(_sources[layer].begin(), _sources[layer].end(), sources.begin(), sources.end(), std::back_inserter(changed));
+
+	_sources[layer].swap(sources);
+
+	for (std::vector<LightSource>::const_iterator i = changed.begin(); i != changed.end(); ++i)
+	{
+		if (i->power > 0)
+		{
+			recalculate(layer, i->x - i->power, i->y - i->power, i->x + i->power, i->y + i->power);
+		}
+	}
+}
+
+/**
+ * Replaces the light sources of a layer within an area of map columns,
+ * keeping the ones outside of it.
+ * @param layer The light layer.
+ * @param x0 The lowest x of the area.
+ * @param y0 The lowest y of the area.
+ * @param x1 The highest x of the area.
+ * @param y1 The highest y of the area.
+ * @param sources The new light sources within the area.
+ */
+void LightField::setSources(int layer, int x0, int y0, int x1, int y1, std::vector<LightSource> sources)
+{
+	for (std::vector<LightSource>::const_iterator i = _sources[layer].begin(); i != _sources[layer].end(); ++i)
+	{
+		if (i->x < x0 || i->x > x1 || i->y < y0 || i->y > y1)
+		{
+			sources.push_back(*i);
+		}
+	}
+	setSources(layer, sources);
+}
+
+/**
+ * Gets the light of a map column on a layer.
+ * @param x X coordinate of the column.
+ * @param y Y coordinate of the column.
+ * @param layer The light layer.
+ * @return The amount of light.
+ */
+int LightField::getLight(int x, int y, int layer) const
+{
+	return _light[layer][y * _save->getWidth() + x];
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_LIGHTFIELD_H
+#define OPENXCOM_LIGHTFIELD_H
+
+#include <vector>
+#include <SDL.h>
+#include "../Savegame/Tile.h"
+
+namespace OpenXcom
+{
+
+class SavedBattleGame;
+
+/**
+ * A light source on the battlescape map. Light doesn't care about levels, so only x and y are kept.
+ */
+struct LightSource
+{
+	int x, y, power;
+	LightSource(int x, int y, int power) : x(x), y(y), power(power) {}
+	bool operator<(const LightSource &other) const
+	{
+		if (x != other.x) return x < other.x;
+		if (y != other.y) return y < other.y;
+		return power < other.power;
+	}
+};
+
+/**
+ * A point of the circular light pattern of a certain power, relative to the light source.
+ */
+struct LightStencilPoint
+{
+	int x, y, light;
+};
+
+/**
+ * Keeps the light of the dynamic lighting layers in one byte per map column,
+ * and the light sources that cause it. When the sources change, only the area
+ * lit by the added or removed sources is recalculated and written to the tiles.
+ */
+class LightField
+{
+private:
+	SavedBattleGame *_save;
+	std::vector<Uint8> _light[Tile::LIGHTLAYERS];
+	std::vector<LightSource> _sources[Tile::LIGHTLAYERS];
+	std::vector<std::vector<LightStencilPoint> > _stencils;
+	const std::vector<LightStencilPoint> &getStencil(int power);
+	void recalculate(int layer, int x0, int y0, int x1, int y1);
+public:
+	/// Creates a new light field for a map.
+	LightField(SavedBattleGame *save);
+	/// Cleans up the light field.
+	~LightField();
+	/// Sets the light sources of a layer.
+	void setSources(int layer, std::vector<LightSource> sources);
+	/// Sets the light sources of a layer within an area.
+	void setSources(int layer, int x0, int y0, int x1, int y1, std::vector<LightSource> sources);
+	/// Gets the light of a map column on a layer.
+	int getLight(int x, int y, int layer) const;
+};
+
+}
+
+#endif
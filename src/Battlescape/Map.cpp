@@ -19,6 +19,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <fstream>
+#include <algorithm>
 #include "Map.h"
 #include "Camera.h"
 #include "UnitSprite.h"
@@ -73,11 +74,15 @@ namespace OpenXcom
  * @param x X position in pixels.
  * @param y Y position in pixels.
  */
-Map::Map(Game *game, int width, int height, int x, int y, int visibleMapHeight) : InteractiveSurface(width, height, x, y), _game(game), _arrow(0), _selectorX(0), _selectorY(0), _cursorType(CT_NORMAL), _cursorSize(1), _animFrame(0), _visibleMapHeight(visibleMapHeight)
+Map::Map(Game *game, int width, int height, int x, int y, int visibleMapHeight) : InteractiveSurface(width, height, x, y), _game(game), _arrow(0), _selectorX(0), _selectorY(0), _cursorType(CT_NORMAL), _cursorSize(1), _animFrame(0), _visibleMapHeight(visibleMapHeight), _redrawAll(true), _drawnMessage(false), _drawnEffects(false), _drawnDebug(false), _drawnAllLayers(false), _drawnSelectedUnit(0)
 {
 	_res = _game->getResourcePack();
 	_spriteWidth = _res->getSurfaceSet("BLANKS.PCK")->getFrame(0)->getWidth();
 	_spriteHeight = _res->getSurfaceSet("BLANKS.PCK")->getFrame(0)->getHeight();
+	_cursorSet = _res->getSurfaceSet("CURSOR.PCK");
+	_itemSet = _res->getSurfaceSet("FLOOROB.PCK");
+	_smokeSet = _res->getSurfaceSet("SMOKE.PCK");
+	_explosionSet = _res->getSurfaceSet("X1.PCK");
 	_save = _game->getSavedGame()->getBattleGame();
 	_message = new BattlescapeMessage(width, visibleMapHeight, 0, 0);
 	_camera = new Camera(_spriteWidth, _spriteHeight, _save->getWidth(), _save->getLength(), _save->getHeight(), this, visibleMapHeight);
@@ -144,13 +149,18 @@ void Map::think()
 }
 
 /**
- * Draws the whole map, part by part.
+ * Draws the map. The map surface keeps what was drawn last time, so only the parts
+ * of the screen covering changed tiles and units are drawn again, unless the view moved.
  */
 void Map::draw()
 {
-	Surface::draw();
 	Tile *t;
 
+	if (_renderLists.empty())
+	{
+		buildRenderLists();
+	}
+
 	projectileInFOV = _save->getDebugMode();
 	if (_projectile)
 	{
@@ -171,13 +181,288 @@ void Map::draw()
 		}
 	}
 
-	if ((_save->getSelectedUnit() && _save->getSelectedUnit()->getVisible()) || _save->getSelectedUnit() == 0 || _save->getDebugMode() || projectileInFOV || explosionInFOV)
+	if (!(_save->getSelectedUnit() && _save->getSelectedUnit()->getVisible()) && _save->getSelectedUnit() != 0 && !_save->getDebugMode() && !projectileInFOV && !explosionInFOV)
 	{
+		// the hidden movement screen doesn't change while it is up
+		if (!_drawnMessage)
+		{
+			Surface::draw();
+			_message->blit(this);
+			_drawnMessage = true;
+		}
+		_redraw = false;
+		_dirtyRects.clear();
+		return;
+	}
+
+	// projectiles and explosions move every frame and can drag the camera along, so they get the whole map redrawn
+	bool effects = _projectile != 0 || !_explosions.empty();
+	if (_drawnMessage || effects || _drawnEffects || _save->getDebugMode() != _drawnDebug ||
+		_camera->getShowAllLayers() != _drawnAllLayers || _camera->getMapOffset() != _drawnOffset)
+	{
+		_redrawAll = true;
+	}
+	_drawnMessage = false;
+	_drawnEffects = effects;
+	_drawnDebug = _save->getDebugMode();
+	_drawnAllLayers = _camera->getShowAllLayers();
+
+	if (!_redrawAll)
+	{
+		invalidateTiles();
+		if (_save->getSelectedUnit() != _drawnSelectedUnit)
+		{
+			if (_drawnSelectedUnit)
+				invalidateUnit(_drawnSelectedUnit);
+			if (_save->getSelectedUnit())
+				invalidateUnit(_save->getSelectedUnit());
+		}
+		if (_waypoints != _drawnWaypoints)
+		{
+			for (std::vector<Position>::const_iterator i = _drawnWaypoints.begin(); i != _drawnWaypoints.end(); ++i)
+				invalidateTile(*i);
+			for (std::vector<Position>::const_iterator i = _waypoints.begin(); i != _waypoints.end(); ++i)
+				invalidateTile(*i);
+		}
+	}
+	_drawnSelectedUnit = _save->getSelectedUnit();
+	_drawnWaypoints = _waypoints;
+
+	if (_redrawAll)
+	{
+		for (int i = 0; i < _save->getWidth()*_save->getLength()*_save->getHeight(); ++i)
+		{
+			Tile *tile = _save->getTiles()[i];
+			if (tile->isInvalid())
+			{
+				buildRenderTile(tile);
+				tile->validate();
+			}
+		}
+		Surface::draw();
 		drawTerrain(this);
+		_drawnOffset = _camera->getMapOffset();
+		_redrawAll = false;
 	}
 	else
 	{
-		_message->blit(this);
+		// the tiles around a dirty rectangle are drawn again too, clipped to it, so they overlap just like before
+		for (std::vector<SDL_Rect>::iterator i = _dirtyRects.begin(); i != _dirtyRects.end(); ++i)
+		{
+			SDL_SetClipRect(_surface, &(*i));
+			drawRect(&(*i), 0);
+			drawTerrain(this);
+		}
+		SDL_SetClipRect(_surface, 0);
+		_redraw = false;
+	}
+	_dirtyRects.clear();
+}
+
+/**
+ * Gets the part of the screen that anything drawn for a tile can cover.
+ * Objects stand up to a sprite above the tile, units walk half a tile into their
+ * neighbours and the selected unit's arrow floats above them.
+ * @param mapPos Position of the tile.
+ * @param rect Pointer to the rectangle to fill.
+ */
+void Map::getTileRect(const Position &mapPos, SDL_Rect *rect)
+{
+	Position screenPosition;
+	_camera->convertMapToScreen(mapPos, &screenPosition);
+	screenPosition += _camera->getMapOffset();
+	rect->x = screenPosition.x - _spriteWidth / 2;
+	rect->y = screenPosition.y - _spriteHeight;
+	rect->w = _spriteWidth * 2;
+	rect->h = _spriteHeight * 3;
+}
+
+/**
+ * Adds a part of the screen to be redrawn, merging it with the ones it overlaps.
+ * @param rect Rectangle to redraw.
+ */
+void Map::addDirtyRect(SDL_Rect rect)
+{
+	if (_redrawAll)
+		return;
+
+	int x0 = std::max((int)rect.x, 0), y0 = std::max((int)rect.y, 0);
+	int x1 = std::min(rect.x + rect.w, getWidth()), y1 = std::min(rect.y + rect.h, _visibleMapHeight);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (std::vector<SDL_Rect>::iterator i = _dirtyRects.begin(); i != _dirtyRects.end(); ++i)
+		{
+			if (x0 < i->x + i->w && i->x < x1 && y0 < i->y + i->h && i->y < y1)
+			{
+				x0 = std::min(x0, (int)i->x);
+				y0 = std::min(y0, (int)i->y);
+				x1 = std::max(x1, i->x + i->w);
+				y1 = std::max(y1, i->y + i->h);
+				_dirtyRects.erase(i);
+				merged = true;
+				break;
+			}
+		}
+	}
+
+	if ((int)_dirtyRects.size() == MAX_DIRTY_RECTS)
+	{
+		invalidateAll();
+		return;
+	}
+	rect.x = x0;
+	rect.y = y0;
+	rect.w = x1 - x0;
+	rect.h = y1 - y0;
+	_dirtyRects.push_back(rect);
+}
+
+/**
+ * Marks the screen area of a tile to be redrawn.
+ * @param mapPos Position of the tile.
+ */
+void Map::invalidateTile(const Position &mapPos)
+{
+	SDL_Rect rect;
+	getTileRect(mapPos, &rect);
+	addDirtyRect(rect);
+}
+
+/**
+ * Marks the screen area of a unit to be redrawn: the tiles it is on, walks from and walks to.
+ * @param unit Pointer to the unit.
+ */
+void Map::invalidateUnit(BattleUnit *unit)
+{
+	if (!unit->getVisible() && !_save->getDebugMode())
+		return;
+
+	int size = unit->getArmor()->getSize();
+	for (int x = 0; x < size; ++x)
+	{
+		for (int y = 0; y < size; ++y)
+		{
+			Position offset(x, y, 0);
+			invalidateTile(unit->getPosition() + offset);
+			if (unit->getLastPosition() != unit->getPosition())
+				invalidateTile(unit->getLastPosition() + offset);
+			if (unit->getDestination() != unit->getPosition())
+				invalidateTile(unit->getDestination() + offset);
+		}
+	}
+}
+
+/**
+ * Marks the whole map to be redrawn.
+ */
+void Map::invalidateAll()
+{
+	_redrawAll = true;
+	_dirtyRects.clear();
+	_redraw = true;
+}
+
+/**
+ * Marks the screen area under the 3D cursor to be redrawn, on the viewed level and the ones below.
+ */
+void Map::invalidateCursor()
+{
+	if (_cursorType == CT_NONE)
+		return;
+
+	for (int z = 0; z <= _camera->getViewHeight(); ++z)
+	{
+		for (int x = _selectorX; x < _selectorX + _cursorSize; ++x)
+		{
+			for (int y = _selectorY; y < _selectorY + _cursorSize; ++y)
+			{
+				invalidateTile(Position(x, y, z));
+			}
+		}
+	}
+}
+
+/**
+ * Marks the screen area of every tile that changed since the last draw to be redrawn.
+ */
+void Map::invalidateTiles()
+{
+	int endZ = _camera->getShowAllLayers()?_save->getHeight() - 1:_camera->getViewHeight();
+	for (int i = 0; i < _save->getWidth()*_save->getLength()*_save->getHeight(); ++i)
+	{
+		Tile *tile = _save->getTiles()[i];
+		if (tile->isInvalid())
+		{
+			buildRenderTile(tile);
+			// levels above the view aren't drawn, changing the view height redraws everything anyway
+			if (tile->getPosition().z <= endZ)
+				invalidateTile(tile->getPosition());
+			tile->validate();
+		}
+	}
+}
+
+/**
+ * Looks up the terrain sprites of a tile for drawTerrain.
+ * Only parts that show a different sprite on some animation frame are looked up while drawing.
+ * @param tile Pointer to the tile.
+ */
+void Map::buildRenderTile(Tile *tile)
+{
+	const Position &pos = tile->getPosition();
+	RenderTile &renderTile = _renderLists[pos.z][pos.x * _save->getLength() + pos.y];
+	renderTile.tile = tile;
+	_camera->convertMapToScreen(pos, &renderTile.screenPosition);
+	renderTile.animated = 0;
+	renderTile.doors = 0;
+	for (int part = 0; part < 4; ++part)
+	{
+		MapData *data = tile->getMapData(part);
+		renderTile.sprites[part] = 0;
+		renderTile.offsets[part] = 0;
+		if (!data)
+			continue;
+		renderTile.offsets[part] = data->getYOffset();
+		if (data->isDoor() || data->isUFODoor())
+		{
+			renderTile.doors |= 1 << part;
+		}
+		bool animated = data->isUFODoor();
+		for (int frame = 1; frame < 8 && !animated; ++frame)
+		{
+			animated = data->getSprite(frame) != data->getSprite(0);
+		}
+		if (animated)
+		{
+			renderTile.animated |= 1 << part;
+		}
+		else
+		{
+			renderTile.sprites[part] = tile->getSprite(part);
+		}
+	}
+	renderTile.halfNorthWall = tile->getMapData(MapData::O_WESTWALL) != 0;
+	renderTile.terrainLevel = tile->getTerrainLevel();
+}
+
+/**
+ * Builds the render lists of every level: the tiles in the order drawTerrain goes through them.
+ */
+void Map::buildRenderLists()
+{
+	_renderLists.resize(_save->getHeight());
+	for (int z = 0; z < _save->getHeight(); ++z)
+	{
+		_renderLists[z].resize(_save->getWidth() * _save->getLength());
+	}
+	for (int i = 0; i < _save->getWidth()*_save->getLength()*_save->getHeight(); ++i)
+	{
+		buildRenderTile(_save->getTiles()[i]);
 	}
 }
 
@@ -198,11 +483,14 @@ void Map::setPalette(SDL_Color *colors, int firstcolor, int ncolors)
 	_message->setBackground(_res->getSurface("TAC00.SCR"));
 	_message->setFonts(_res->getFont("Big.fnt"), _res->getFont("Small.fnt"));
 	_message->setText(_game->getLanguage()->getString("STR_HIDDEN_MOVEMENT"));
+	_drawnMessage = false;
+	invalidateAll();
 }
 
 /**
 * Draw the terrain.
 * Keep this function as optimised as possible. It's big to minimise overhead of function calls.
+* Only the tiles reaching into the clipping rectangle of the surface are drawn.
 * @param surface The surface to draw on.
 */
 void Map::drawTerrain(Surface *surface)
@@ -220,18 +508,28 @@ void Map::drawTerrain(Surface *surface)
 	bool invalid;
 	int tileShade, wallShade, tileColor, wallColor;
 	NumberText *_numWaypid = 0;
+	const RenderTile *renderTile;
+	Position mapOffset = _camera->getMapOffset();
+	SDL_Rect clip;
+	SDL_GetClipRect(surface->getSurface(), &clip);
+	int clipX0 = clip.x - _spriteWidth * 2, clipY0 = clip.y - _spriteHeight * 2;
+	int clipX1 = clip.x + clip.w + _spriteWidth * 2, clipY1 = clip.y + clip.h + _spriteHeight * 2;
 	
 	// get corner map coordinates to give rough boundaries in which tiles to redraw are
-	_camera->convertScreenToMap(0, 0, &beginX, &dummy);
-	_camera->convertScreenToMap(surface->getWidth(), 0, &dummy, &beginY);
-	_camera->convertScreenToMap(surface->getWidth(), surface->getHeight(), &endX, &dummy);
-	_camera->convertScreenToMap(0, surface->getHeight(), &dummy, &endY);
+	_camera->convertScreenToMap(clipX0, clipY0, &beginX, &dummy);
+	_camera->convertScreenToMap(clipX1, clipY0, &dummy, &beginY);
+	_camera->convertScreenToMap(clipX1, clipY1, &endX, &dummy);
+	_camera->convertScreenToMap(clipX0, clipY1, &dummy, &endY);
 	beginY -= (_camera->getViewHeight() * 2);
 	beginX -= (_camera->getViewHeight() * 2);
 	if (beginX < 0)
 		beginX = 0;
 	if (beginY < 0)
 		beginY = 0;
+	if (endX > _save->getWidth() - 1)
+		endX = _save->getWidth() - 1;
+	if (endY > _save->getLength() - 1)
+		endY = _save->getLength() - 1;
 
 	// if we got bullet, get the highest x and y tiles to draw it on
 	if (_projectile && !_projectile->getItem())
@@ -282,19 +580,17 @@ void Map::drawTerrain(Surface *surface)
 	{
         for (int itX = beginX; itX <= endX; itX++)
 		{
-            for (int itY = beginY; itY <= endY; itY++)
+			renderTile = &_renderLists[itZ][itX * _save->getLength() + beginY];
+            for (int itY = beginY; itY <= endY; itY++, renderTile++)
 			{
-				mapPosition = Position(itX, itY, itZ);
-				_camera->convertMapToScreen(mapPosition, &screenPosition);
-				screenPosition += _camera->getMapOffset();
+				screenPosition = renderTile->screenPosition + mapOffset;
 
-				// only render cells that are inside the surface
-				if (screenPosition.x > -_spriteWidth && screenPosition.x < surface->getWidth() + _spriteWidth &&
-					screenPosition.y > -_spriteHeight && screenPosition.y < surface->getHeight() + _spriteHeight )
+				// only render cells that reach into the clipping rectangle, see getTileRect()
+				if (screenPosition.x - _spriteWidth / 2 < clip.x + clip.w && screenPosition.x + _spriteWidth * 3 / 2 > clip.x &&
+					screenPosition.y - _spriteHeight < clip.y + clip.h && screenPosition.y + _spriteHeight * 2 > clip.y)
 				{
-					tile = _save->getTile(mapPosition);
-
-					if (!tile) continue;
+					tile = renderTile->tile;
+					mapPosition = Position(itX, itY, itZ);
 
 					if (tile->isDiscovered(2))
 					{
@@ -319,9 +615,9 @@ void Map::drawTerrain(Surface *surface)
 					*/
 
 					// Draw floor
-					tmpSurface = tile->getSprite(MapData::O_FLOOR);
+					tmpSurface = (renderTile->animated & (1 << MapData::O_FLOOR))? tile->getSprite(MapData::O_FLOOR) : renderTile->sprites[MapData::O_FLOOR];
 					if (tmpSurface)
-						tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - tile->getMapData(MapData::O_FLOOR)->getYOffset(), tileShade, false, tileColor);
+						tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - renderTile->offsets[MapData::O_FLOOR], tileShade, false, tileColor);
 					unit = tile->getUnit();
 
 					// Draw cursor back
@@ -342,13 +638,13 @@ void Map::drawTerrain(Surface *surface)
 								else
 									frameNumber = 6; // red static crosshairs
 							}
-							tmpSurface = _res->getSurfaceSet("CURSOR.PCK")->getFrame(frameNumber);
+							tmpSurface = _cursorSet->getFrame(frameNumber);
 							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 						}
 						else if (_camera->getViewHeight() > itZ)
 						{
 							frameNumber = 2; // blue box
-							tmpSurface = _res->getSurfaceSet("CURSOR.PCK")->getFrame(frameNumber);
+							tmpSurface = _cursorSet->getFrame(frameNumber);
 							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 						}
 					}
@@ -357,47 +653,38 @@ void Map::drawTerrain(Surface *surface)
 					if (!tile->isVoid())
 					{
 						// Draw west wall
-						tmpSurface = tile->getSprite(MapData::O_WESTWALL);
+						tmpSurface = (renderTile->animated & (1 << MapData::O_WESTWALL))? tile->getSprite(MapData::O_WESTWALL) : renderTile->sprites[MapData::O_WESTWALL];
 						if (tmpSurface)
 						{
-							if ((tile->getMapData(MapData::O_WESTWALL)->isDoor() || tile->getMapData(MapData::O_WESTWALL)->isUFODoor())
-								 && (tile->isDiscovered(0) || tile->isDiscovered(1)))
+							if ((renderTile->doors & (1 << MapData::O_WESTWALL)) && (tile->isDiscovered(0) || tile->isDiscovered(1)))
 								wallShade = 0;
 							else
 								wallShade = tileShade;
-							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - tile->getMapData(MapData::O_WESTWALL)->getYOffset(), wallShade, false, wallColor);
+							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - renderTile->offsets[MapData::O_WESTWALL], wallShade, false, wallColor);
 						}
 						// Draw north wall
-						tmpSurface = tile->getSprite(MapData::O_NORTHWALL);
+						tmpSurface = (renderTile->animated & (1 << MapData::O_NORTHWALL))? tile->getSprite(MapData::O_NORTHWALL) : renderTile->sprites[MapData::O_NORTHWALL];
 						if (tmpSurface)
 						{
-							if ((tile->getMapData(MapData::O_NORTHWALL)->isDoor() || tile->getMapData(MapData::O_NORTHWALL)->isUFODoor())
-								 && (tile->isDiscovered(0) || tile->isDiscovered(1)))
+							if ((renderTile->doors & (1 << MapData::O_NORTHWALL)) && (tile->isDiscovered(0) || tile->isDiscovered(1)))
 								wallShade = 0;
 							else
 								wallShade = tileShade;
-							if (tile->getMapData(MapData::O_WESTWALL))
-							{
-								tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - tile->getMapData(MapData::O_NORTHWALL)->getYOffset(), wallShade, true, wallColor);
-							}
-							else
-							{
-								tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - tile->getMapData(MapData::O_NORTHWALL)->getYOffset(), wallShade, false, wallColor);
-							}
+							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - renderTile->offsets[MapData::O_NORTHWALL], wallShade, renderTile->halfNorthWall, wallColor);
 						}
 						// Draw object
-						if (tile->getMapData(MapData::O_OBJECT))
-						{
-							tmpSurface = tile->getSprite(MapData::O_OBJECT);
-							if (tmpSurface)
-								tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - tile->getMapData(MapData::O_OBJECT)->getYOffset(), tileShade, false, wallColor);
-						}
+						tmpSurface = (renderTile->animated & (1 << MapData::O_OBJECT))? tile->getSprite(MapData::O_OBJECT) : renderTile->sprites[MapData::O_OBJECT];
+						if (tmpSurface)
+							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y - renderTile->offsets[MapData::O_OBJECT], tileShade, false, wallColor);
 						// draw an item on top of the floor (if any)
-						int sprite = tile->getTopItemSprite();
-						if (sprite != -1)
+						if (!tile->getInventory()->empty())
 						{
-							tmpSurface = _res->getSurfaceSet("FLOOROB.PCK")->getFrame(sprite);
-							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y + tile->getTerrainLevel(), tileShade, false, wallColor);
+							int sprite = tile->getTopItemSprite();
+							if (sprite != -1)
+							{
+								tmpSurface = _itemSet->getFrame(sprite);
+								tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y + renderTile->terrainLevel, tileShade, false, wallColor);
+							}
 						}
 						
 					}
@@ -498,7 +785,7 @@ void Map::drawTerrain(Surface *surface)
 							if (unit->getFire() > 0)
 							{
 								frameNumber = 4 + (_animFrame / 2);
-								tmpSurface = _res->getSurfaceSet("SMOKE.PCK")->getFrame(frameNumber);
+								tmpSurface = _smokeSet->getFrame(frameNumber);
 								tmpSurface->blitNShade(surface, screenPosition.x + offset.x, screenPosition.y + offset.y, 0);
 							}
 						}
@@ -532,7 +819,7 @@ void Map::drawTerrain(Surface *surface)
 								if (tunit->getFire() > 0)
 								{
 									frameNumber = 4 + (_animFrame / 2);
-									tmpSurface = _res->getSurfaceSet("SMOKE.PCK")->getFrame(frameNumber);
+									tmpSurface = _smokeSet->getFrame(frameNumber);
 									tmpSurface->blitNShade(surface, screenPosition.x + offset.x, screenPosition.y + offset.y, 0);
 								}
 							}
@@ -557,19 +844,19 @@ void Map::drawTerrain(Surface *surface)
 								else
 									frameNumber = 6; // red static crosshairs
 							}
-							tmpSurface = _res->getSurfaceSet("CURSOR.PCK")->getFrame(frameNumber);
+							tmpSurface = _cursorSet->getFrame(frameNumber);
 							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 						}
 						else if (_camera->getViewHeight() > itZ)
 						{
 							frameNumber = 5; // blue box
-							tmpSurface = _res->getSurfaceSet("CURSOR.PCK")->getFrame(frameNumber);
+							tmpSurface = _cursorSet->getFrame(frameNumber);
 							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 						}
 						if (_cursorType > 2 && _camera->getViewHeight() == itZ)
 						{
 							int frame[6] = {0, 0, 0, 11, 13, 15};
-							tmpSurface = _res->getSurfaceSet("CURSOR.PCK")->getFrame(frame[_cursorType] + (_animFrame / 4));
+							tmpSurface = _cursorSet->getFrame(frame[_cursorType] + (_animFrame / 4));
 							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 						}
 					}
@@ -580,7 +867,7 @@ void Map::drawTerrain(Surface *surface)
 					{
 						if ((*i) == mapPosition)
 						{
-							tmpSurface = _res->getSurfaceSet("CURSOR.PCK")->getFrame(7);
+							tmpSurface = _cursorSet->getFrame(7);
 							tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 							_numWaypid->setValue(waypid);
 							_numWaypid->draw();
@@ -602,7 +889,7 @@ void Map::drawTerrain(Surface *surface)
 						{
 							frameNumber += (_animFrame / 2) + tile->getAnimationOffset();
 						}
-						tmpSurface = _res->getSurfaceSet("SMOKE.PCK")->getFrame(frameNumber);
+						tmpSurface = _smokeSet->getFrame(frameNumber);
 						tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 					}
 					if (tile->getSmoke() && tile->isDiscovered(2))
@@ -616,7 +903,7 @@ void Map::drawTerrain(Surface *surface)
 						{
 							frameNumber += (_animFrame / 2) + tile->getAnimationOffset();
 						}
-						tmpSurface = _res->getSurfaceSet("SMOKE.PCK")->getFrame(frameNumber);
+						tmpSurface = _smokeSet->getFrame(frameNumber);
 						tmpSurface->blitNShade(surface, screenPosition.x, screenPosition.y, 0);
 					}
 				}
@@ -635,14 +922,14 @@ void Map::drawTerrain(Surface *surface)
 			{
 				Position voxelPos = (*i)->getPosition();
 				_camera->convertVoxelToScreen(voxelPos, &bulletPositionScreen);
-				tmpSurface = _res->getSurfaceSet("X1.PCK")->getFrame((*i)->getCurrentFrame());
+				tmpSurface = _explosionSet->getFrame((*i)->getCurrentFrame());
 				tmpSurface->blitNShade(surface, bulletPositionScreen.x - 64, bulletPositionScreen.y - 64, 0);
 			}
 			else
 			{
 				Position voxelPos = (*i)->getPosition();
 				_camera->convertVoxelToScreen(voxelPos, &bulletPositionScreen);
-				tmpSurface = _res->getSurfaceSet("SMOKE.PCK")->getFrame((*i)->getCurrentFrame());
+				tmpSurface = _smokeSet->getFrame((*i)->getCurrentFrame());
 				tmpSurface->blitNShade(surface, bulletPositionScreen.x - 15, bulletPositionScreen.y - 15, 0);
 			}
 		}
@@ -695,13 +982,17 @@ void Map::mouseOver(Action *action, State *state)
  */
 void Map::setSelectorPosition(int mx, int my)
 {
-	int oldX = _selectorX, oldY = _selectorY;
+	int newX, newY;
 
 	if (!mx && !my) return; // cursor is offscreen
-	_camera->convertScreenToMap(mx, my, &_selectorX, &_selectorY);
+	_camera->convertScreenToMap(mx, my, &newX, &newY);
 
-	if (oldX != _selectorX || oldY != _selectorY)
+	if (newX != _selectorX || newY != _selectorY)
 	{
+		invalidateCursor();
+		_selectorX = newX;
+		_selectorY = newY;
+		invalidateCursor();
 		_redraw = true;
 	}
 }
@@ -715,10 +1006,15 @@ void Map::animate(bool redraw)
 	_animFrame++;
 	if (_animFrame == 8) _animFrame = 0;
 
-	// animate tiles
+	// animate tiles, fire and smoke go to their next frame every other frame
 	for (int i = 0; i < _save->getWidth()*_save->getHeight()*_save->getLength(); ++i)
 	{
-		_save->getTiles()[i]->animate();
+		Tile *tile = _save->getTiles()[i];
+		tile->animate();
+		if ((tile->getFire() || tile->getSmoke()) && _animFrame % 2 == 0)
+		{
+			tile->invalidate();
+		}
 	}
 
 	// animate certain units (large flying units have a propultion animation)
@@ -729,7 +1025,18 @@ void Map::animate(bool redraw)
 			(*i)->setCache(0);
 			cacheUnit(*i);
 		}
+		else if ((*i)->getFire() > 0 && _animFrame % 2 == 0)
+		{
+			invalidateUnit(*i);
+		}
+	}
+
+	// the arrow above the selected unit bobs and the cursor blinks
+	if (_save->getSelectedUnit())
+	{
+		invalidateUnit(_save->getSelectedUnit());
 	}
+	invalidateCursor();
 
 	if (redraw) _redraw = true;
 }
@@ -861,11 +1168,13 @@ int Map::getTerrainLevel(Position pos, int size)
  */
 void Map::setCursorType(CursorType type, int size)
 {
+	invalidateCursor();
 	_cursorType = type;
 	if (_cursorType == CT_NORMAL)
 		_cursorSize = size;
 	else
 		_cursorSize = 1;
+	invalidateCursor();
 }
 
 /**
@@ -935,6 +1244,7 @@ void Map::cacheUnit(BattleUnit *unit)
 			unitSprite->blit(cache);
 			unit->setCache(cache, i);
 		}
+		invalidateUnit(unit);
 	}	
 	delete unitSprite;
 }
@@ -20,6 +20,7 @@
 #define OPENXCOM_MAP_H
 
 #include "../Engine/InteractiveSurface.h"
+#include "Position.h"
 #include <set>
 #include <vector>
 
@@ -29,8 +30,8 @@ namespace OpenXcom
 class ResourcePack;
 class SavedBattleGame;
 class Surface;
+class SurfaceSet;
 class MapData;
-class Position;
 class Tile;
 class BattleUnit;
 class BulletSprite;
@@ -49,6 +50,8 @@ class Map : public InteractiveSurface
 {
 private:
 	static const int SCROLL_INTERVAL = 50;
+	/// Past this many separate dirty rectangles, the whole map is redrawn.
+	static const int MAX_DIRTY_RECTS = 16;
 	Timer *_scrollTimer;
 	Game *_game;
 	SavedBattleGame *_save;
@@ -70,6 +73,35 @@ private:
 	void drawTerrain(Surface *surface);
 	int getTerrainLevel(Position pos, int size);
 	std::vector<Position> _waypoints;
+	/// What the back buffer was last drawn with, to tell when it has to be redrawn whole.
+	bool _redrawAll, _drawnMessage, _drawnEffects, _drawnDebug, _drawnAllLayers;
+	Position _drawnOffset;
+	BattleUnit *_drawnSelectedUnit;
+	std::vector<Position> _drawnWaypoints;
+	std::vector<SDL_Rect> _dirtyRects;
+	void getTileRect(const Position &mapPos, SDL_Rect *rect);
+	void addDirtyRect(SDL_Rect rect);
+	void invalidateCursor();
+	void invalidateTiles();
+	/// A tile's terrain sprites, looked up ahead so drawTerrain doesn't have to.
+	struct RenderTile
+	{
+		Tile *tile;
+		/// Screen position of the tile with the camera at the map origin.
+		Position screenPosition;
+		/// Sprite of each part, left out for parts that animate.
+		Surface *sprites[4];
+		int offsets[4];
+		/// Bits of the parts that animate and the parts that are doors.
+		int animated, doors;
+		bool halfNorthWall;
+		int terrainLevel;
+	};
+	/// The tiles of each level in drawing order, rebuilt where the terrain changes.
+	std::vector<std::vector<RenderTile> > _renderLists;
+	SurfaceSet *_cursorSet, *_itemSet, *_smokeSet, *_explosionSet;
+	void buildRenderTile(Tile *tile);
+	void buildRenderLists();
 public:
 	/// Creates a new map at the specified position and size.
 	Map(Game *game, int width, int height, int x, int y, int visibleMapHeight);
@@ -118,6 +150,12 @@ public:
 	std::vector<Position> *getWaypoints();
 	/// Set mouse-buttons' pressed state
 	void setButtonsPressed(Uint8 button, bool pressed);
+	/// Marks the screen area of a tile to be redrawn.
+	void invalidateTile(const Position &mapPos);
+	/// Marks the screen area of a unit to be redrawn.
+	void invalidateUnit(BattleUnit *unit);
+	/// Marks the whole map to be redrawn.
+	void invalidateAll();
 
 };
 
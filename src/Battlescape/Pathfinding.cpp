@@ -17,14 +17,18 @@
  * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <list>
+#include <algorithm>
 #include "Pathfinding.h"
 #include "PathfindingNode.h"
 #include "PathfindingOpenSet.h"
+#include "ClusterGraph.h"
+#include "PhaseTimer.h"
 #include "../Savegame/SavedBattleGame.h"
 #include "../Savegame/Tile.h"
 #include "../Ruleset/MapData.h"
 #include "../Ruleset/Armor.h"
 #include "../Savegame/BattleUnit.h"
+#include "../Savegame/UnitGrid.h"
 
 namespace OpenXcom
 {
@@ -33,7 +37,7 @@ namespace OpenXcom
  * Sets up a Pathfinding.
  * @param save pointer to SavedBattleGame object.
  */
-Pathfinding::Pathfinding(SavedBattleGame *save) : _save(save), _nodes(), _unit(0), _pathPreviewed(false)
+Pathfinding::Pathfinding(SavedBattleGame *save) : _save(save), _nodes(), _search(0), _ignoreUnits(false), _terrainVersion(0), _tuMapUnit(0), _tuMapBudget(0), _tuMapTurn(0), _tuMapTerrainVersion(0), _tuMapOccupancyVersion(0), _unit(0), _pathPreviewed(false)
 {
 	_size = _save->getHeight() * _save->getLength() * _save->getWidth();
 	// Initialize one node per tile
@@ -52,7 +56,10 @@ Pathfinding::Pathfinding(SavedBattleGame *save) : _save(save), _nodes(), _unit(0
  */
 Pathfinding::~Pathfinding()
 {
-	// Nothing more to do here.
+	for (std::vector<MovementGraph>::iterator i = _graphs.begin(); i != _graphs.end(); ++i)
+	{
+		delete i->clusters;
+	}
 }
 
 /**
@@ -62,7 +69,30 @@ Pathfinding::~Pathfinding()
  */
 PathfindingNode *Pathfinding::getNode(const Position& pos)
 {
-	return &_nodes[_save->getTileIndex(pos)];
+	PathfindingNode *node = &_nodes[_save->getTileIndex(pos)];
+	// nodes left over from an earlier search count as reset
+	if (!node->isSearched(_search))
+	{
+		node->reset(_search);
+	}
+	return node;
+}
+
+/**
+ * Starts a new search. Instead of resetting every node on the map,
+ * nodes are reset when the search first gets to them.
+ */
+void Pathfinding::newSearch()
+{
+	_openSet.clear();
+	++_search;
+	if (_search == 0)
+	{
+		// the counter wrapped, so old nodes could look like they belong to this search
+		for (std::vector<PathfindingNode>::iterator it = _nodes.begin(); it != _nodes.end(); ++it)
+			it->reset(0);
+		_search = 1;
+	}
 }
 
 /**
@@ -73,29 +103,12 @@ PathfindingNode *Pathfinding::getNode(const Position& pos)
 
 void Pathfinding::calculate(BattleUnit *unit, Position endPosition)
 {
+	PhaseTimer timer(PhaseTimer::PHASE_PATHFINDING);
 	Position startPosition = unit->getPosition();
 	_movementType = unit->getArmor()->getMovementType();
 	_unit = unit;
 
-	Tile *destinationTile = _save->getTile(endPosition);
-
-	// check if destination is not blocked
-	if (isBlocked(destinationTile, MapData::O_FLOOR) || isBlocked(destinationTile, MapData::O_OBJECT)) return;
-
-	// the following check avoids that the unit walks behind the stairs if we click behind the stairs to make it go up the stairs.
-	// it only works if the unit is on one of the 2 tiles on the stairs, or on the tile right in front of the stairs.
-	if (isOnStairs(startPosition, endPosition))
-	{
-		endPosition.z++;
-		destinationTile = _save->getTile(endPosition);
-	}
-
-	// check if we have floor, else lower destination (for non flying units only, because otherwise they never reached this place)
-	while (canFallDown(destinationTile) && 	_movementType != MT_FLY)
-	{
-		endPosition.z--;
-		destinationTile = _save->getTile(endPosition);
-	}
+	if (!getDestination(startPosition, &endPosition)) return;
 
 	_path.clear();
 
@@ -106,10 +119,44 @@ void Pathfinding::calculate(BattleUnit *unit, Position endPosition)
 		return;
 	}
 
+	// long paths are planned through the clusters of the map first
+	if (hierarchicalPath(startPosition, endPosition)) return;
+
 	// Now try through A*.
 	aStarPath(startPosition, endPosition);
 }
 
+/**
+ * Finds where a unit really ends up when sent to a position.
+ * The unit and movement type must have already been set.
+ * @param startPosition The position to start from.
+ * @param endPosition The position the unit is sent to, updated to where it ends up.
+ * @return False if the unit can't go there.
+ */
+bool Pathfinding::getDestination(const Position &startPosition, Position *endPosition)
+{
+	Tile *destinationTile = _save->getTile(*endPosition);
+
+	// check if destination is not blocked
+	if (isBlocked(destinationTile, MapData::O_FLOOR) || isBlocked(destinationTile, MapData::O_OBJECT)) return false;
+
+	// the following check avoids that the unit walks behind the stairs if we click behind the stairs to make it go up the stairs.
+	// it only works if the unit is on one of the 2 tiles on the stairs, or on the tile right in front of the stairs.
+	if (isOnStairs(startPosition, *endPosition))
+	{
+		endPosition->z++;
+		destinationTile = _save->getTile(*endPosition);
+	}
+
+	// check if we have floor, else lower destination (for non flying units only, because otherwise they never reached this place)
+	while (canFallDown(destinationTile) && 	_movementType != MT_FLY)
+	{
+		endPosition->z--;
+		destinationTile = _save->getTile(*endPosition);
+	}
+	return true;
+}
+
 /**
  * Calculate the shortest path using a simple A-Star algorithm.
  * The unit information and movement type must have already been set.
@@ -120,14 +167,12 @@ void Pathfinding::calculate(BattleUnit *unit, Position endPosition)
  */
 bool Pathfinding::aStarPath(const Position &startPosition, const Position &endPosition)
 {
-	// reset every node, so we have to check them all
-	for (std::vector<PathfindingNode>::iterator it = _nodes.begin(); it != _nodes.end(); ++it)
-		it->reset();
+	newSearch();
 
 	// start position is the first one in our "open" list
 	PathfindingNode *start = getNode(startPosition);
 	start->connect(0, 0, 0, endPosition);
-	PathfindingOpenSet openList;
+	PathfindingOpenSet &openList = _openSet;
 	openList.push(start);
 
 	// if the open list is empty, we've reached the end
@@ -171,9 +216,104 @@ bool Pathfinding::aStarPath(const Position &startPosition, const Position &endPo
 	return false;
 }
 
+/**
+ * Calculate a long path by planning it through the clusters of the map first.
+ * The clusters only know the terrain, so the path is checked against the units on the way,
+ * and if one is in the way the caller should fall back to searching tiles.
+ * The unit information and movement type must have already been set.
+ * @param startPosition The position to start from.
+ * @param endPosition The position we want to reach.
+ * @return True if the path was found this way.
+ */
+bool Pathfinding::hierarchicalPath(const Position &startPosition, const Position &endPosition)
+{
+	MovementGraph *graph = getGraph(_unit);
+	if (!graph->clusters)
+	{
+		graph->clusters = new ClusterGraph(_save, this);
+	}
+	if (!graph->clusters->isFar(startPosition, endPosition)) return false;
+
+	std::vector<int> path;
+	if (!graph->clusters->findPath(_unit, startPosition, endPosition, &path)) return false;
+	_path.assign(path.rbegin(), path.rend()); //paths are stored in reverse order
+	if (checkPath(startPosition, endPosition, _path)) return true;
+	_path.clear();
+	return false;
+}
+
+/**
+ * Checks if the unit can walk a path with the units where they are now, and ends up where it should.
+ * The unit information and movement type must have already been set.
+ * @param startPosition The position the path starts from.
+ * @param endPosition The position the path should end at.
+ * @param path The directions of the path, in the reverse order paths are stored in.
+ * @return True if the path can be walked.
+ */
+bool Pathfinding::checkPath(const Position &startPosition, const Position &endPosition, const std::vector<int> &path)
+{
+	Position pos = startPosition;
+	for (std::vector<int>::const_reverse_iterator i = path.rbegin(); i != path.rend(); ++i)
+	{
+		Position nextPos;
+		if (getTUCost(pos, *i, &nextPos, _unit) == 255) return false;
+		pos = nextPos;
+	}
+	return pos == endPosition;
+}
+
+/**
+ * Calculate a path that is walked again and again, like the legs of a patrol between nodes.
+ * The path is found as if there were no units, and kept until the terrain changes.
+ * Each time it's checked against the units on the way, and if one is in the way
+ * the path is calculated around them like any other.
+ * @param unit The unit to move.
+ * @param endPosition The position to go to.
+ */
+void Pathfinding::calculateRoute(BattleUnit *unit, Position endPosition)
+{
+	PhaseTimer timer(PhaseTimer::PHASE_PATHFINDING);
+	Position startPosition = unit->getPosition();
+	_movementType = unit->getArmor()->getMovementType();
+	_unit = unit;
+	MovementGraph *graph = getGraph(unit);
+	std::pair<int, int> key(_save->getTileIndex(startPosition), _save->getTileIndex(endPosition));
+	std::map<std::pair<int, int>, Route>::iterator route = graph->routes.find(key);
+	if (route == graph->routes.end())
+	{
+		_ignoreUnits = true;
+		_path.clear();
+		calculate(unit, endPosition);
+		Route newRoute;
+		newRoute.path = _path;
+		newRoute.end = startPosition;
+		for (std::vector<int>::const_reverse_iterator i = _path.rbegin(); i != _path.rend(); ++i)
+		{
+			Position nextPos;
+			getTUCost(newRoute.end, *i, &nextPos, unit);
+			newRoute.end = nextPos;
+		}
+		_ignoreUnits = false;
+		if (_path.empty())
+		{
+			calculate(unit, endPosition);
+			return;
+		}
+		route = graph->routes.insert(std::make_pair(key, newRoute)).first;
+	}
+	if (checkPath(startPosition, route->second.end, route->second.path))
+	{
+		_path = route->second.path;
+		return;
+	}
+	calculate(unit, endPosition);
+}
+
 /**
  * Get's the TU cost to move from 1 tile to the other(ONE STEP ONLY). But also updates the endPosition, because it is possible
  * the unit goes upstairs or falls down while walking.
+ * The moves from a tile are worked out once and kept in a movement graph, until the terrain around it changes.
+ * Only when other units stand where the unit is going, the cost is worked out again.
  * @param startPosition
  * @param direction
  * @param endPosition pointer
@@ -183,6 +323,151 @@ bool Pathfinding::aStarPath(const Position &startPosition, const Position &endPo
 int Pathfinding::getTUCost(const Position &startPosition, int direction, Position *endPosition, BattleUnit *unit)
 {
 	_unit = unit;
+	int size = _unit->getArmor()->getSize() - 1;
+	directionToVector(direction, endPosition);
+	*endPosition += startPosition;
+
+	// other units only matter on the columns the unit moves to, otherwise the terrain decides
+	if (!_ignoreUnits && hasOtherUnits(*endPosition, size))
+	{
+		return calculateTUCost(startPosition, direction, endPosition);
+	}
+	return getTerrainTUCost(startPosition, direction, endPosition, unit);
+}
+
+/**
+ * Get's the TU cost to move from 1 tile to the other(ONE STEP ONLY), and where the unit ends up,
+ * as if there were no other units. The moves are looked up in the movement graph.
+ * @param startPosition
+ * @param direction
+ * @param endPosition pointer
+ * @param unit
+ * @return TU cost - 255 if movement impossible
+ */
+int Pathfinding::getTerrainTUCost(const Position &startPosition, int direction, Position *endPosition, BattleUnit *unit)
+{
+	_unit = unit;
+	directionToVector(direction, endPosition);
+	*endPosition += startPosition;
+
+	MovementGraph *graph = getGraph(_unit);
+	int index = _save->getTileIndex(startPosition);
+	if (!graph->known[index])
+	{
+		bool ignoreUnits = _ignoreUnits;
+		_ignoreUnits = true;
+		for (int dir = 0; dir < 10; ++dir)
+		{
+			Position end;
+			int cost = calculateTUCost(startPosition, dir, &end);
+			Position vector;
+			directionToVector(dir, &vector);
+			graph->cost[index * 10 + dir] = cost;
+			graph->levels[index * 10 + dir] = end.z - startPosition.z - vector.z;
+		}
+		_ignoreUnits = ignoreUnits;
+		graph->known[index] = true;
+	}
+	endPosition->z += graph->levels[index * 10 + direction];
+	return graph->cost[index * 10 + direction];
+}
+
+/**
+ * Gets the movement graph for the kind of unit, making it if it's the first such unit.
+ * Besides the size of the unit, it depends on its movement type for going up and down,
+ * and the movement type of the last calculated path for everything else.
+ * @param unit The moving unit.
+ * @return Pointer to the graph.
+ */
+Pathfinding::MovementGraph *Pathfinding::getGraph(BattleUnit *unit)
+{
+	MovementType unitMovementType = unit->getArmor()->getMovementType();
+	int size = unit->getArmor()->getSize();
+	for (std::vector<MovementGraph>::iterator i = _graphs.begin(); i != _graphs.end(); ++i)
+	{
+		if (i->movementType == _movementType && i->unitMovementType == unitMovementType && i->size == size)
+		{
+			return &(*i);
+		}
+	}
+	MovementGraph graph;
+	graph.movementType = _movementType;
+	graph.unitMovementType = unitMovementType;
+	graph.size = size;
+	graph.clusters = 0;
+	_graphs.push_back(graph);
+	_graphs.back().known.resize(_size, false);
+	_graphs.back().cost.resize(_size * 10);
+	_graphs.back().levels.resize(_size * 10);
+	return &_graphs.back();
+}
+
+/**
+ * Checks if there are units other than the moving unit at any level of the columns of a position.
+ * @param position The position the unit moves to.
+ * @param size The size of the unit minus one.
+ * @return True if another unit could be in the way.
+ */
+bool Pathfinding::hasOtherUnits(const Position &position, int size)
+{
+	for (int x = size; x >= 0; x--)
+	{
+		for (int y = size; y >= 0; y--)
+		{
+			for (int z = 0; z < _save->getHeight(); ++z)
+			{
+				Tile *tile = _save->getTile(Position(position.x + x, position.y + y, z));
+				if (tile && tile->getUnit() && tile->getUnit() != _unit)
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Forget the known moves of the tiles whose moves could go over a changed part of the map.
+ * @param position The position of the change.
+ * @param radius How far around the position the terrain changed.
+ */
+void Pathfinding::invalidateTerrain(const Position &position, int radius)
+{
+	_terrainVersion++;
+	// moves look at most 3 tiles to the side, for big units
+	radius += 3;
+	for (std::vector<MovementGraph>::iterator i = _graphs.begin(); i != _graphs.end(); ++i)
+	{
+		for (int z = 0; z < _save->getHeight(); ++z)
+		{
+			for (int y = std::max(0, position.y - radius); y <= std::min(_save->getLength() - 1, position.y + radius); ++y)
+			{
+				for (int x = std::max(0, position.x - radius); x <= std::min(_save->getWidth() - 1, position.x + radius); ++x)
+				{
+					i->known[_save->getTileIndex(Position(x, y, z))] = false;
+				}
+			}
+		}
+		if (i->clusters)
+		{
+			i->clusters->invalidate(position, radius);
+		}
+		// a route could go over the change, or a shorter one could open up
+		i->routes.clear();
+	}
+}
+
+/**
+ * Works out the TU cost to move from 1 tile to the other(ONE STEP ONLY), and where the unit ends up.
+ * When ignoring units, this only depends on the terrain.
+ * @param startPosition
+ * @param direction
+ * @param endPosition pointer
+ * @return TU cost - 255 if movement impossible
+ */
+int Pathfinding::calculateTUCost(const Position &startPosition, int direction, Position *endPosition)
+{
 	directionToVector(direction, endPosition);
 	*endPosition += startPosition;
 	bool fellDown = false;
@@ -210,7 +495,8 @@ int Pathfinding::getTUCost(const Position &startPosition, int direction, Positio
 				return 255;
 
 			// can't walk on top of other units
-			if (_save->getTile(*endPosition + Position(x,y,-1))
+			if (!_ignoreUnits
+				&& _save->getTile(*endPosition + Position(x,y,-1))
 				&& _save->getTile(*endPosition + Position(x,y,-1))->getUnit()
 				&& _save->getTile(*endPosition + Position(x,y,-1))->getUnit() != _unit
 				&& _movementType != MT_FLY)
@@ -229,7 +515,7 @@ int Pathfinding::getTUCost(const Position &startPosition, int direction, Positio
 			else
 			{
 				// check if we can go up or down through gravlift or fly
-				if (validateUpDown(unit, startPosition, direction))
+				if (validateUpDown(_unit, startPosition, direction))
 				{
 					cost = 8; // vertical movement by flying suit or grav lift
 				}
@@ -394,7 +680,7 @@ bool Pathfinding::isBlocked(Tile *tile, const int part)
 			return false;
 	}
 
-	if (part == MapData::O_FLOOR)
+	if (part == MapData::O_FLOOR && !_ignoreUnits)
 	{
 		BattleUnit *unit = tile->getUnit();
 		if (unit != 0 && unit != _unit) return true;
@@ -484,7 +770,8 @@ bool Pathfinding::canFallDown(Tile *here)
 	if (here->getPosition().z == 0)
 		return false;
 
-	if (_save->selectUnit(here->getPosition() + Position(0, 0, -1)) &&
+	if (!_ignoreUnits &&
+		_save->selectUnit(here->getPosition() + Position(0, 0, -1)) &&
 		_save->selectUnit(here->getPosition() + Position(0, 0, -1)) != _unit)
 		return false;
 
@@ -734,15 +1021,15 @@ bool Pathfinding::bresenhamPath(const Position& origin, const Position& target)
  */
 std::vector<int> Pathfinding::findReachable(BattleUnit *unit, int tuMax)
 {
+	PhaseTimer timer(PhaseTimer::PHASE_PATHFINDING);
 	const Position &start = unit->getPosition();
+	_movementType = unit->getArmor()->getMovementType();
+	_unit = unit;
 
-	for (std::vector<PathfindingNode>::iterator it = _nodes.begin(); it != _nodes.end(); ++it)
-	{
-		it->reset();
-	}
+	newSearch();
 	PathfindingNode *startNode = getNode(start);
 	startNode->connect(0, 0, 0);
-	PathfindingOpenSet unvisited;
+	PathfindingOpenSet &unvisited = _openSet;
 	unvisited.push(startNode);
 	std::vector<PathfindingNode*> reachable;
 	while (!unvisited.empty())
@@ -757,12 +1044,12 @@ std::vector<int> Pathfinding::findReachable(BattleUnit *unit, int tuMax)
 			int tuCost = getTUCost(currentPos, direction, &nextPos, unit);
 			if (tuCost == 255) // Skip unreachable / blocked
 				continue;
-			if (tuCost > tuMax) // Run out of TUs
+			int totalTuCost = currentNode->getTUCost() + tuCost;
+			if (totalTuCost > tuMax) // Run out of TUs
 				continue;
 			PathfindingNode *nextNode = getNode(nextPos);
 			if (nextNode->isChecked()) // Our algorithm means this node is already at minimum cost.
 				continue;
-			int totalTuCost = currentNode->getTUCost() + tuCost;
 			// If this node is unvisited or visited from a better path.
 			if (!nextNode->inOpenSet() || nextNode->getTUCost() > totalTuCost)
 			{
@@ -783,4 +1070,106 @@ std::vector<int> Pathfinding::findReachable(BattleUnit *unit, int tuMax)
 	return tiles;
 }
 
+/**
+ * Works out the TU cost and the cheapest way to every tile a unit can reach within a TU budget.
+ * The result is kept until the unit moves, the terrain changes, any unit goes on or off a tile
+ * or the turn ends, so asking again for the same unit and budget costs nothing.
+ * @param unit Pointer to the unit.
+ * @param tuMax The maximum cost of the path to each tile.
+ */
+void Pathfinding::calculateTUMap(BattleUnit *unit, int tuMax)
+{
+	PhaseTimer timer(PhaseTimer::PHASE_PATHFINDING);
+	if (hasTUMap(unit, tuMax))
+	{
+		return;
+	}
+
+	if (_tuMapCost.empty())
+	{
+		_tuMapCost.resize(_size, -1);
+		_tuMapDirection.resize(_size, -1);
+	}
+	for (std::vector<int>::const_iterator i = _tuMapTiles.begin(); i != _tuMapTiles.end(); ++i)
+	{
+		_tuMapCost[*i] = -1;
+		_tuMapDirection[*i] = -1;
+	}
+
+	_tuMapTiles = findReachable(unit, tuMax);
+	for (std::vector<int>::const_iterator i = _tuMapTiles.begin(); i != _tuMapTiles.end(); ++i)
+	{
+		// the nodes still hold the search that just ran
+		_tuMapCost[*i] = _nodes[*i].getTUCost();
+		_tuMapDirection[*i] = _nodes[*i].getPrevNode() ? _nodes[*i].getPrevDir() : -1;
+	}
+
+	_tuMapUnit = unit;
+	_tuMapOrigin = unit->getPosition();
+	_tuMapBudget = tuMax;
+	_tuMapTurn = _save->getTurn();
+	_tuMapTerrainVersion = _terrainVersion;
+	_tuMapOccupancyVersion = _save->getUnitGrid()->getOccupancyVersion();
+}
+
+/**
+ * Gets the TU cost of reaching a position, according to the last TU map.
+ * @param position The position.
+ * @return The TU cost, or -1 if it can't be reached within the budget.
+ */
+int Pathfinding::getTUMapCost(const Position &position) const
+{
+	if (_tuMapCost.empty() || !_save->getTile(position))
+		return -1;
+	return _tuMapCost[_save->getTileIndex(position)];
+}
+
+/**
+ * Gets the direction of the last step on the cheapest way to a position, according to the last TU map.
+ * Following these directions back leads to the unit.
+ * @param position The position.
+ * @return The direction, or -1 for the unit's own position and positions that can't be reached.
+ */
+int Pathfinding::getTUMapDirection(const Position &position) const
+{
+	if (_tuMapDirection.empty() || !_save->getTile(position))
+		return -1;
+	return _tuMapDirection[_save->getTileIndex(position)];
+}
+
+/**
+ * Checks if the last TU map was worked out for a unit and budget, and nothing changed since.
+ * @param unit Pointer to the unit.
+ * @param tuMax The maximum cost of the path to each tile.
+ * @return True if calculateTUMap would have nothing to do.
+ */
+bool Pathfinding::hasTUMap(BattleUnit *unit, int tuMax) const
+{
+	return unit == _tuMapUnit && unit->getPosition() == _tuMapOrigin && tuMax == _tuMapBudget
+		&& _save->getTurn() == _tuMapTurn && _terrainVersion == _tuMapTerrainVersion && _save->getUnitGrid()->getOccupancyVersion() == _tuMapOccupancyVersion;
+}
+
+/**
+ * Checks if a unit can walk to a position within a TU budget, like calculate would find a path there.
+ * This uses the TU map of the unit, so many positions can be checked with one search.
+ * @param unit Pointer to the unit.
+ * @param endPosition The position the unit would be sent to.
+ * @param tuMax The maximum cost of the path.
+ * @return True if there is a path.
+ */
+bool Pathfinding::isReachable(BattleUnit *unit, Position endPosition, int tuMax)
+{
+	_movementType = unit->getArmor()->getMovementType();
+	_unit = unit;
+
+	if (!getDestination(unit->getPosition(), &endPosition))
+		return false;
+	// there is no path to where the unit already is
+	if (endPosition == unit->getPosition())
+		return false;
+
+	calculateTUMap(unit, tuMax);
+	return getTUMapCost(endPosition) != -1;
+}
+
 }
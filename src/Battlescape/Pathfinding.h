@@ -20,7 +20,10 @@
 #define OPENXCOM_PATHFINDING_H
 
 #include <vector>
+#include <map>
+#include <SDL.h>
 #include "Position.h"
+#include "PathfindingOpenSet.h"
 #include "../Ruleset/MapData.h"
 
 namespace OpenXcom
@@ -31,6 +34,7 @@ class SavedBattleGame;
 class PathfindingNode;
 class Tile;
 class BattleUnit;
+class ClusterGraph;
 
 /**
  * A utility class that calculates the shortest path between two points on the battlescape map.
@@ -41,6 +45,52 @@ private:
 	SavedBattleGame *_save;
 	std::vector<PathfindingNode> _nodes;
 	int _size;
+	unsigned int _search;
+	PathfindingOpenSet _openSet;
+	/// A path kept to be walked again, and where it ends.
+	struct Route
+	{
+		std::vector<int> path;
+		Position end;
+	};
+	/// The TU costs of the moves from every tile for one kind of unit, worked out as if there were no other units.
+	struct MovementGraph
+	{
+		MovementType movementType, unitMovementType;
+		int size;
+		/// Whether the moves from a tile are known.
+		std::vector<bool> known;
+		/// TU cost and change of level of the move in each of the 10 directions from a tile.
+		std::vector<Uint16> cost;
+		std::vector<Sint8> levels;
+		/// The clusters of the map for planning long paths, made when first needed.
+		ClusterGraph *clusters;
+		/// Paths walked again and again, by the tiles they go between, until the terrain changes.
+		std::map<std::pair<int, int>, Route> routes;
+	};
+	std::vector<MovementGraph> _graphs;
+	bool _ignoreUnits;
+	/// Gets the movement graph for a unit.
+	MovementGraph *getGraph(BattleUnit *unit);
+	/// Checks if units other than the moving one stand on the columns of a position.
+	bool hasOtherUnits(const Position &position, int size);
+	/// Works out the TU cost of a move from the terrain and units.
+	int calculateTUCost(const Position &startPosition, const int direction, Position *endPosition);
+	/// Counts the terrain changes, to know when a TU map is out of date.
+	int _terrainVersion;
+	/// The last TU map: cost and last direction for every tile, the tiles reached and what it was made for.
+	std::vector<int> _tuMapCost, _tuMapTiles;
+	std::vector<Sint8> _tuMapDirection;
+	BattleUnit *_tuMapUnit;
+	Position _tuMapOrigin;
+	int _tuMapBudget, _tuMapTurn, _tuMapTerrainVersion;
+	unsigned int _tuMapOccupancyVersion;
+	/// Checks if a unit can walk a path with the units where they are now.
+	bool checkPath(const Position &startPosition, const Position &endPosition, const std::vector<int> &path);
+	/// Finds where a unit really ends up when sent to a position.
+	bool getDestination(const Position &startPosition, Position *endPosition);
+	/// Starts a new search, leaving all nodes unchecked.
+	void newSearch();
 	std::vector<int> _path;
 	MovementType _movementType;
 	/// Gets the node at certain position.
@@ -56,16 +106,21 @@ private:
 	bool bresenhamPath(const Position& origin, const Position& target);
 	///Try to find a path between two positions.
 	bool aStarPath(const Position& origin, const Position& target);
+	///Try to find a long path through the clusters of the map.
+	bool hierarchicalPath(const Position& origin, const Position& target);
 public:
 	static const int DIR_UP = 8;
 	static const int DIR_DOWN = 9;
 	static const int O_BIGWALL = -1;
+	static const int TU_UNLIMITED = 0x7fffffff;
 	/// Creates a new Pathfinding class
 	Pathfinding(SavedBattleGame *save);
 	/// Cleans up the Pathfinding.
 	~Pathfinding();
 	/// Calculate the shortest path.
 	void calculate(BattleUnit *unit, Position endPosition);
+	/// Calculate a path that is walked again and again.
+	void calculateRoute(BattleUnit *unit, Position endPosition);
 	/// Converts direction to a vector.
 	static void directionToVector(const int direction, Position *vector);
 	/// Check whether a path is ready gives the first direction.
@@ -74,6 +129,8 @@ public:
 	int dequeuePath();
 	/// Get's the TU cost to move from 1 tile to the other.
 	int getTUCost(const Position &startPosition, const int direction, Position *endPosition, BattleUnit *unit);
+	/// Get the TU cost of a move as if there were no other units.
+	int getTerrainTUCost(const Position &startPosition, const int direction, Position *endPosition, BattleUnit *unit);
 	/// Abort the current path.
 	void abortPath();
 	bool validateUpDown(BattleUnit *bu, Position startPosition, const int direction);
@@ -81,6 +138,18 @@ public:
 	bool removePreview();
 	/// Get all reachable tiles, based on cost.
 	std::vector<int> findReachable(BattleUnit *unit, int tuMax);
+	/// Work out the TU cost of reaching every tile within a budget.
+	void calculateTUMap(BattleUnit *unit, int tuMax);
+	/// Check if the last TU map is still right for a unit and budget.
+	bool hasTUMap(BattleUnit *unit, int tuMax) const;
+	/// Get the TU cost of reaching a position in the last TU map.
+	int getTUMapCost(const Position &position) const;
+	/// Get the direction of the last step to a position in the last TU map.
+	int getTUMapDirection(const Position &position) const;
+	/// Check if a unit can walk to a position.
+	bool isReachable(BattleUnit *unit, Position endPosition, int tuMax);
+	/// Forget the moves that go over changed terrain.
+	void invalidateTerrain(const Position &position, int radius = 0);
 };
 
 }
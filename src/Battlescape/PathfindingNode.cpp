@@ -27,7 +27,7 @@ namespace OpenXcom
  * Sets up a PathfindingNode.
  * @param pos Position.
  */
-PathfindingNode::PathfindingNode(Position pos) : _pos(pos), _openentry(0)
+PathfindingNode::PathfindingNode(Position pos) : _pos(pos), _search(0), _tuCost(0), _tuGuess(0), _prevNode(0), _heapIndex(-1), _prevDir(0), _checked(false)
 {
 
 }
@@ -50,11 +50,13 @@ const Position &PathfindingNode::getPosition() const
 }
 /**
  * Reset node.
+ * @param search The search the node is used for from now on.
  */
-void PathfindingNode::reset()
+void PathfindingNode::reset(unsigned int search)
 {
+	_search = search;
 	_checked = false;
-	_openentry = 0;
+	_heapIndex = -1;
 }
 
 /**
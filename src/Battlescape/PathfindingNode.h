@@ -25,7 +25,6 @@ namespace OpenXcom
 {
 
 class PathfindingOpenSet;
-class OpenSetEntry;
 
 /**
  * A class that holds pathfinding info for a certain node on the map.
@@ -34,14 +33,16 @@ class PathfindingNode
 {
 private:
 	Position _pos;
-	bool _checked;
+	/// The search this node was last reset for.
+	unsigned int _search;
 	int _tuCost;
-	PathfindingNode* _prevNode;
-	int _prevDir;
 	/// Approximate cost to reach goal position.
 	int _tuGuess;
+	PathfindingNode* _prevNode;
 	// Invasive field needed by PathfindingOpenSet
-	OpenSetEntry *_openentry;
+	int _heapIndex;
+	signed char _prevDir;
+	bool _checked;
 	friend class PathfindingOpenSet;
 public:
 	/// Creates a new PathfindingNode class
@@ -51,7 +52,9 @@ public:
 	/// Get the node position
 	const Position &getPosition() const;
 	/// Reset node.
-	void reset();
+	void reset(unsigned int search);
+	/// Was the node reset for this search?
+	bool isSearched(unsigned int search) const { return _search == search; }
 	/// is checked?
 	bool isChecked() const;
 	/// Mark as checked
@@ -65,7 +68,7 @@ public:
 	/// get previous walking direction
 	int getPrevDir() const;
 	/// Is this node already in a PathfindingOpenSet?
-	bool inOpenSet() const { return _openentry; }
+	bool inOpenSet() const { return _heapIndex >= 0; }
 	/// Get approximate cost to reach target position.
 	int getTUGuess() const { return _tuGuess; }
 	/// Connect to previous node along the path.
@@ -16,34 +16,83 @@
  * You should have received a copy of the GNU General Public License
  * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <cassert>
+#include <algorithm>
 #include "PathfindingOpenSet.h"
 #include "PathfindingNode.h"
 
 namespace OpenXcom
 {
 
+/// Number of children of every entry in the heap.
+static const size_t HEAP_ARITY = 4;
+
 /**
- * Cleans up all the entries still in set.
+ * Removes all nodes from the set, keeping the memory for the next search.
  */
-PathfindingOpenSet::~PathfindingOpenSet()
+void PathfindingOpenSet::clear()
 {
-	while (!_queue.empty())
+	for (std::vector<OpenSetEntry>::iterator i = _heap.begin(); i != _heap.end(); ++i)
 	{
-		delete _queue.top();
-		_queue.pop();
+		i->_node->_heapIndex = -1;
 	}
+	_heap.clear();
+}
+
+/**
+ * Put an entry in a place of the heap, and let its node know where it is.
+ * @param entry The entry.
+ * @param index The place in the heap.
+ */
+void PathfindingOpenSet::place(const OpenSetEntry &entry, size_t index)
+{
+	_heap[index] = entry;
+	entry._node->_heapIndex = index;
 }
 
 /**
- * Keep removing all discarded entries that have come to the top of the queue.
+ * Move an entry up the heap, until its parent is cheaper.
+ * @param index The place of the entry in the heap.
  */
-void PathfindingOpenSet::removeDiscarded()
+void PathfindingOpenSet::siftUp(size_t index)
 {
-	while (!_queue.empty() && !_queue.top()->_node)
+	OpenSetEntry entry = _heap[index];
+	while (index > 0)
 	{
-		delete _queue.top();
-		_queue.pop();
+		size_t parent = (index - 1) / HEAP_ARITY;
+		if (_heap[parent]._cost <= entry._cost)
+			break;
+		place(_heap[parent], index);
+		index = parent;
 	}
+	place(entry, index);
+}
+
+/**
+ * Move an entry down the heap, until all its children are more expensive.
+ * @param index The place of the entry in the heap.
+ */
+void PathfindingOpenSet::siftDown(size_t index)
+{
+	OpenSetEntry entry = _heap[index];
+	for (;;)
+	{
+		size_t first = index * HEAP_ARITY + 1;
+		if (first >= _heap.size())
+			break;
+		size_t last = std::min(first + HEAP_ARITY, _heap.size());
+		size_t best = first;
+		for (size_t child = first + 1; child < last; ++child)
+		{
+			if (_heap[child]._cost < _heap[best]._cost)
+				best = child;
+		}
+		if (entry._cost <= _heap[best]._cost)
+			break;
+		place(_heap[best], index);
+		index = best;
+	}
+	place(entry, index);
 }
 
 /**
@@ -54,32 +103,39 @@ void PathfindingOpenSet::removeDiscarded()
 PathfindingNode *PathfindingOpenSet::pop()
 {
 	assert(!empty());
-	PathfindingNode *nd = _queue.top()->_node;
-	delete _queue.top();
-	_queue.pop();
-	nd->_openentry = 0;
-
-	// Discarded entries might be visible now.
-	removeDiscarded();
+	PathfindingNode *nd = _heap.front()._node;
+	nd->_heapIndex = -1;
+	OpenSetEntry last = _heap.back();
+	_heap.pop_back();
+	if (!_heap.empty())
+	{
+		_heap.front() = last;
+		siftDown(0);
+	}
 	return nd;
 }
 
 /**
  * Place the node in the set.
- * If the node was already in the set, the previous entry is discarded.
+ * If the node was already in the set, it is moved to match its new cost.
  * It is the caller's responsibility to never re-add a node with a worse cost.
  * @param node A pointer to the node to add.
  */
 void PathfindingOpenSet::push(PathfindingNode *node)
 {
-	OpenSetEntry *entry = new OpenSetEntry;
-	entry->_node = node;
-	entry->_cost = node->getTUCost() + node->getTUGuess();
-	if (node->_openentry)
-		node->_openentry->_node = 0;
-	node->_openentry = entry;
-	_queue.push(entry);
+	OpenSetEntry entry;
+	entry._node = node;
+	entry._cost = node->getTUCost() + node->getTUGuess();
+	if (node->inOpenSet())
+	{
+		_heap[node->_heapIndex]._cost = entry._cost;
+		siftUp(node->_heapIndex);
+	}
+	else
+	{
+		_heap.push_back(entry);
+		siftUp(_heap.size() - 1);
+	}
 }
 
-
 }
@@ -19,7 +19,7 @@
 #ifndef OPENXCOM_PATHFINDINGOPENSET_H
 #define OPENXCOM_PATHFINDINGOPENSET_H
 
-#include <queue>
+#include <vector>
 
 namespace OpenXcom
 {
@@ -32,44 +32,34 @@ struct OpenSetEntry
 	PathfindingNode *_node;
 };
 
-/**
- * Helper class to compare entries through pointers.
- */
-class EntryCompare
-{
-public:
- 	/**
-	 * Compare entries @a *a and @a *b.
-         * @param a Pointer to first entry.
-         * @param b Pointer to second entry.
-	 * @return true If entry @a *b must come before @a *a.
-	 */
-	bool operator()(OpenSetEntry *a, OpenSetEntry *b)
-	{
-		return b->_cost < a->_cost;
-	}
-};
-
 /**
  * A class that holds references to the nodes to be examined in pathfinding.
+ * The nodes are kept in a 4-ary heap, and every node knows its place in it, so
+ * a node that is found through a cheaper path is moved up instead of added again.
+ * The set is meant to be kept and reused by its owner, so the heap doesn't need
+ * to be allocated again for every search.
  */
 class PathfindingOpenSet
 {
 public:
-	/// Cleanup the set and free allocated memory.
-	~PathfindingOpenSet();
 	/// Get the next node to check.
 	PathfindingNode *pop();
-	/// Add a node in the set.
+	/// Add a node in the set, or update its cost.
 	void push(PathfindingNode *node);
 	/// Is the set empty?
-	bool empty() const { return _queue.empty(); }
+	bool empty() const { return _heap.empty(); }
+	/// Remove all nodes from the set.
+	void clear();
 
 private:
-	std::priority_queue<OpenSetEntry*, std::vector<OpenSetEntry*>, EntryCompare> _queue;
+	std::vector<OpenSetEntry> _heap;
 
-	/// Remove reachable discarded entries.
-	void removeDiscarded();
+	/// Move an entry up the heap to where it belongs.
+	void siftUp(size_t index);
+	/// Move an entry down the heap to where it belongs.
+	void siftDown(size_t index);
+	/// Put an entry in a place of the heap.
+	void place(const OpenSetEntry &entry, size_t index);
 };
 
 }
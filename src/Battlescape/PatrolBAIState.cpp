@@ -24,6 +24,7 @@
 #include "../Savegame/BattleUnit.h"
 #include "../Savegame/SavedBattleGame.h"
 #include "../Savegame/Node.h"
+#include "../Savegame/NodeIndex.h"
 #include "../Engine/RNG.h"
 #include "../Ruleset/Armor.h"
 #include "../Savegame/Tile.h"
@@ -138,17 +139,7 @@ void PatrolBAIState::think(BattleAction *action)
 	if (_fromNode == 0)
 	{
 		// assume closest node as "from node"
-		int closest = 1000000;
-		for (std::vector<Node*>::iterator i = _game->getNodes()->begin(); i != _game->getNodes()->end(); ++i)
-		{
-			node = *i;
-			int d = _game->getTileEngine()->distance(_unit->getPosition(), node->getPosition());
-			if (d < closest)
-			{
-				_fromNode = node;
-				closest = d;
-			}
-		}
+		_fromNode = _game->getNodeIndex()->getClosestNode(_unit->getPosition());
 	}
 
 	if (_toNode == 0)
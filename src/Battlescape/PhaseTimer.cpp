@@ -0,0 +1,78 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PhaseTimer.h"
+#include "../Engine/CrossPlatform.h"
+
+namespace OpenXcom
+{
+
+double PhaseTimer::_time[PHASES] = {0, 0, 0, 0};
+int PhaseTimer::_depth[PHASES] = {0, 0, 0, 0};
+
+/**
+ * Starts timing a phase, unless it's being timed already.
+ * @param phase The phase.
+ */
+PhaseTimer::PhaseTimer(Phase phase) : _phase(phase), _start(0)
+{
+	if (_depth[_phase]++ == 0)
+	{
+		_start = CrossPlatform::getMilliseconds();
+	}
+}
+
+/**
+ * Stops timing the phase, adding the time to it.
+ */
+PhaseTimer::~PhaseTimer()
+{
+	if (--_depth[_phase] == 0)
+	{
+		_time[_phase] += CrossPlatform::getMilliseconds() - _start;
+	}
+}
+
+/**
+ * Gets the time spent in a phase since the last reset.
+ * @param phase The phase.
+ * @return Time in milliseconds.
+ */
+double PhaseTimer::getTime(Phase phase)
+{
+	return _time[phase];
+}
+
+/**
+ * Gets the name of a phase, for reports.
+ * @param phase The phase.
+ * @return The name.
+ */
+const char *PhaseTimer::getName(Phase phase)
+{
+	switch (phase)
+	{
+	case PHASE_FOV: return "FOV";
+	case PHASE_PATHFINDING: return "pathfinding";
+	case PHASE_REACTION_FIRE: return "reaction fire";
+	case PHASE_LIGHTING: return "lighting";
+	default: return "";
+	}
+}
+
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_PHASETIMER_H
+#define OPENXCOM_PHASETIMER_H
+
+namespace OpenXcom
+{
+
+/**
+ * Adds up the time the battlescape spends in each kind of costly calculation.
+ * A PhaseTimer is put on the stack for the length of a calculation. One inside
+ * another of the same phase isn't counted twice, but phases can overlap: reaction
+ * fire includes the field of view it works out.
+ */
+class PhaseTimer
+{
+public:
+	enum Phase { PHASE_FOV, PHASE_PATHFINDING, PHASE_REACTION_FIRE, PHASE_LIGHTING, PHASES };
+private:
+	static double _time[PHASES];
+	static int _depth[PHASES];
+	Phase _phase;
+	double _start;
+public:
+	/// Starts timing a phase.
+	PhaseTimer(Phase phase);
+	/// Stops timing the phase.
+	~PhaseTimer();
+	/// Gets the time spent in a phase since the start, in milliseconds.
+	static double getTime(Phase phase);
+	/// Gets the name of a phase.
+	static const char *getName(Phase phase);
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include "ThreatMap.h"
+#include "TileEngine.h"
+#include "../Savegame/SavedBattleGame.h"
+#include "../Savegame/Tile.h"
+
+namespace OpenXcom
+{
+
+/**
+ * Sets up a threat map. It's filled in when first asked about a turn.
+ * @param save Pointer to the battlescape.
+ */
+ThreatMap::ThreatMap(SavedBattleGame *save) : _save(save), _side(FACTION_PLAYER), _turn(0)
+{
+	_exposure.resize(_save->getWidth() * _save->getLength() * _save->getHeight(), 0);
+}
+
+/**
+ * Deletes the threat map.
+ */
+ThreatMap::~ThreatMap()
+{
+}
+
+/**
+ * Checks if a unit is an enemy of the side whose turn it is. Aliens fight everyone else.
+ * @param unit The unit.
+ * @return True if the unit is an enemy.
+ */
+bool ThreatMap::isEnemy(BattleUnit *unit) const
+{
+	return (unit->getFaction() == FACTION_HOSTILE) != (_side == FACTION_HOSTILE);
+}
+
+/**
+ * Makes the map again when the turn changed, from the enemies seen by the units of the side whose turn it is.
+ */
+void ThreatMap::update()
+{
+	if (_side == _save->getSide() && _turn == _save->getTurn())
+		return;
+	_side = _save->getSide();
+	_turn = _save->getTurn();
+	_watchers.clear();
+	std::fill(_exposure.begin(), _exposure.end(), 0);
+	for (std::vector<BattleUnit*>::iterator i = _save->getUnits()->begin(); i != _save->getUnits()->end(); ++i)
+	{
+		if ((*i)->getFaction() != _side || (*i)->isOut())
+			continue;
+		for (std::vector<BattleUnit*>::iterator j = (*i)->getVisibleUnits()->begin(); j != (*i)->getVisibleUnits()->end(); ++j)
+		{
+			addWatcher(*j);
+		}
+	}
+}
+
+/**
+ * Adds an enemy to the map, unless it's there already. The tiles it could see are traced
+ * when the map is next asked about. Only enemies of the side whose turn it is count.
+ * @param unit The enemy.
+ */
+void ThreatMap::addWatcher(BattleUnit *unit)
+{
+	update();
+	if (!isEnemy(unit) || unit->isOut())
+		return;
+	for (std::vector<Watcher>::const_iterator i = _watchers.begin(); i != _watchers.end(); ++i)
+	{
+		if (i->unit == unit)
+			return;
+	}
+	Watcher watcher;
+	watcher.unit = unit;
+	watcher.traced = false;
+	_watchers.push_back(watcher);
+}
+
+/**
+ * Takes the enemies that are out off the map, and adds the tiles of the new ones.
+ */
+void ThreatMap::updateWatchers()
+{
+	std::vector<Watcher>::iterator kept = _watchers.begin();
+	for (std::vector<Watcher>::iterator i = _watchers.begin(); i != _watchers.end(); ++i)
+	{
+		if (i->unit->isOut())
+		{
+			for (std::vector<int>::const_iterator j = i->tiles.begin(); j != i->tiles.end(); ++j)
+			{
+				_exposure[*j]--;
+			}
+			continue;
+		}
+		if (!i->traced)
+		{
+			std::vector<Tile*> tiles;
+			_save->getTileEngine()->findExposedTiles(i->unit, &tiles);
+			for (std::vector<Tile*>::iterator j = tiles.begin(); j != tiles.end(); ++j)
+			{
+				int index = _save->getTileIndex((*j)->getPosition());
+				_exposure[index]++;
+				i->tiles.push_back(index);
+			}
+			i->traced = true;
+		}
+		if (kept != i)
+		{
+			kept->unit = i->unit;
+			kept->traced = i->traced;
+			kept->tiles.swap(i->tiles);
+		}
+		++kept;
+	}
+	_watchers.erase(kept, _watchers.end());
+}
+
+/**
+ * Gets how many of the known enemies of the side whose turn it is could see a unit at a position.
+ * @param position The position.
+ * @return The number of enemies, 0 if the position is off the map.
+ */
+int ThreatMap::getExposure(const Position &position)
+{
+	update();
+	updateWatchers();
+	if (!_save->getTile(position))
+		return 0;
+	return _exposure[_save->getTileIndex(position)];
+}
+
+}
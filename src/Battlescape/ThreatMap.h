@@ -0,0 +1,71 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_THREATMAP_H
+#define OPENXCOM_THREATMAP_H
+
+#include <vector>
+#include <SDL.h>
+#include "Position.h"
+#include "../Savegame/BattleUnit.h"
+
+namespace OpenXcom
+{
+
+class SavedBattleGame;
+
+/**
+ * Keeps for every tile how many of the known enemies of the side whose turn it is could see it.
+ * It's made again for each turn from the enemies the units of that side see, and enemies
+ * spotted during the turn are added as they are seen, so the AI can check tiles without tracing lines.
+ * The tiles an enemy could see are only traced when the map is first asked about after it was added,
+ * and enemies that are out stop counting.
+ */
+class ThreatMap
+{
+private:
+	/// A known enemy and the tiles it adds to the map, once they are traced.
+	struct Watcher
+	{
+		BattleUnit *unit;
+		bool traced;
+		std::vector<int> tiles;
+	};
+	SavedBattleGame *_save;
+	UnitFaction _side;
+	int _turn;
+	std::vector<Watcher> _watchers;
+	std::vector<Uint16> _exposure;
+	bool isEnemy(BattleUnit *unit) const;
+	void updateWatchers();
+public:
+	/// Creates a threat map for a battle.
+	ThreatMap(SavedBattleGame *save);
+	/// Cleans up the threat map.
+	~ThreatMap();
+	/// Makes the map for the turn, if it isn't made yet.
+	void update();
+	/// Adds an enemy spotted by the side whose turn it is.
+	void addWatcher(BattleUnit *unit);
+	/// Gets how many known enemies could see a position.
+	int getExposure(const Position &position);
+};
+
+}
+
+#endif
@@ -18,16 +18,24 @@
  */
 #define _USE_MATH_DEFINES
 #include <cmath>
-#include <set>
+#include <algorithm>
 #include "TileEngine.h"
+#include "LightField.h"
 #include <SDL.h>
+#include <SDL_thread.h>
 #include "BattleAIState.h"
 #include "AggroBAIState.h"
+#include "Pathfinding.h"
+#include "ThreatMap.h"
+#include "PhaseTimer.h"
 #include "../Savegame/SavedBattleGame.h"
 #include "../Savegame/Tile.h"
+#include "../Savegame/UnitGrid.h"
 #include "../Savegame/BattleUnit.h"
 #include "../Savegame/Soldier.h"
 #include "../Engine/RNG.h"
+#include "../Engine/Options.h"
+#include "../Engine/CrossPlatform.h"
 #include "../Ruleset/MapDataSet.h"
 #include "../Ruleset/MapData.h"
 #include "../Ruleset/Unit.h"
@@ -42,9 +50,12 @@ namespace OpenXcom
  * Sets up a TileEngine.
  * @param save pointer to SavedBattleGame object.
  */
-TileEngine::TileEngine(SavedBattleGame *save, std::vector<Uint16> *voxelData) : _save(save), _voxelData(voxelData), _personalLighting(true)
+TileEngine::TileEngine(SavedBattleGame *save, std::vector<Uint16> *voxelData) : _save(save), _voxelData(voxelData), _personalLighting(true), _blastRayLength(0)
 {
-
+	_lightField = new LightField(_save);
+	_roofLevels.resize(_save->getWidth() * _save->getLength(), -1);
+	_voxelPlaneIndex.resize(_save->getWidth() * _save->getLength() * _save->getHeight(), VOXELPLANE_LIVE);
+	buildRayFan();
 }
 
 /**
@@ -52,7 +63,7 @@ TileEngine::TileEngine(SavedBattleGame *save, std::vector<Uint16> *voxelData) :
  */
 TileEngine::~TileEngine()
 {
-
+	delete _lightField;
 }
 
 
@@ -61,12 +72,13 @@ TileEngine::~TileEngine()
   */
 void TileEngine::calculateSunShading()
 {
-	const int layer = 0; // Ambient lighting layer.
-
-	for (int i = 0; i < _save->getWidth() * _save->getLength() * _save->getHeight(); ++i)
+	PhaseTimer timer(PhaseTimer::PHASE_LIGHTING);
+	for (int x = 0; x < _save->getWidth(); ++x)
 	{
-		_save->getTiles()[i]->resetLight(layer);
-		calculateSunShading(_save->getTiles()[i]);
+		for (int y = 0; y < _save->getLength(); ++y)
+		{
+			calculateSunShading(x, y);
+		}
 	}
 }
 
@@ -83,13 +95,38 @@ void TileEngine::calculateSunShading(Tile *tile)
 	// At night/dusk sun isn't dropping shades blocked by roofs
 	if (_save->getGlobalShade() <= 4)
 	{
-		if (verticalBlockage(_save->getTile(Position(tile->getPosition().x, tile->getPosition().y, _save->getHeight() - 1)), tile, DT_NONE))
+		if (_roofLevels[tile->getPosition().y * _save->getWidth() + tile->getPosition().x] > tile->getPosition().z)
 		{
 			power -= 2;
 		}
 	}
 
-	tile->addLight(power, layer);
+	tile->setLight(std::max(power, 0), layer);
+}
+
+/**
+  * Finds the highest floor that blocks the sun in a map column, and recalculates the sun shading of the column.
+  * Every tile below that floor is under a roof.
+  * @param x X coordinate of the column.
+  * @param y Y coordinate of the column.
+  */
+void TileEngine::calculateSunShading(int x, int y)
+{
+	int roof = -1;
+	for (int z = _save->getHeight() - 1; z >= 0; --z)
+	{
+		if (blockage(_save->getTile(Position(x, y, z)), MapData::O_FLOOR, DT_NONE))
+		{
+			roof = z;
+			break;
+		}
+	}
+	_roofLevels[y * _save->getWidth() + x] = roof;
+
+	for (int z = 0; z < _save->getHeight(); ++z)
+	{
+		calculateSunShading(_save->getTile(Position(x, y, z)));
+	}
 }
 
 /**
@@ -97,46 +134,63 @@ void TileEngine::calculateSunShading(Tile *tile)
   */
 void TileEngine::calculateTerrainLighting()
 {
+	PhaseTimer timer(PhaseTimer::PHASE_LIGHTING);
+	calculateTerrainLighting(0, 0, _save->getWidth() - 1, _save->getLength() - 1);
+}
+
+/**
+  * Recalculate static lighting of the map columns within an area, for when only that part of the map changed.
+  * @param x0 The lowest x of the area.
+  * @param y0 The lowest y of the area.
+  * @param x1 The highest x of the area.
+  * @param y1 The highest y of the area.
+  */
+void TileEngine::calculateTerrainLighting(int x0, int y0, int x1, int y1)
+{
+	PhaseTimer timer(PhaseTimer::PHASE_LIGHTING);
 	const int layer = 1; // Static lighting layer.
 	const int fireLightPower = 15; // amount of light a fire generates
+	std::vector<LightSource> sources;
 
-	// reset all light to 0 first
-	for (int i = 0; i < _save->getWidth() * _save->getLength() * _save->getHeight(); ++i)
-	{
-		_save->getTiles()[i]->resetLight(layer);
-	}
-
-	// add lighting of terrain
-	for (int i = 0; i < _save->getWidth() * _save->getLength() * _save->getHeight(); ++i)
+	for (int z = 0; z < _save->getHeight(); ++z)
 	{
-		// only floors and objects can light up
-		if (_save->getTiles()[i]->getMapData(MapData::O_FLOOR)
-			&& _save->getTiles()[i]->getMapData(MapData::O_FLOOR)->getLightSource())
+		for (int y = y0; y <= y1; ++y)
 		{
-			addLight(_save->getTiles()[i]->getPosition(), _save->getTiles()[i]->getMapData(MapData::O_FLOOR)->getLightSource(), layer);
-		}
-		if (_save->getTiles()[i]->getMapData(MapData::O_OBJECT)
-			&& _save->getTiles()[i]->getMapData(MapData::O_OBJECT)->getLightSource())
-		{
-			addLight(_save->getTiles()[i]->getPosition(), _save->getTiles()[i]->getMapData(MapData::O_OBJECT)->getLightSource(), layer);
-		}
+			for (int x = x0; x <= x1; ++x)
+			{
+				Tile *tile = _save->getTile(Position(x, y, z));
+				const Position &pos = tile->getPosition();
 
-		// fires
-		if (_save->getTiles()[i]->getFire())
-		{
-			addLight(_save->getTiles()[i]->getPosition(), fireLightPower, layer);
-		}
+				// only floors and objects can light up
+				if (tile->getMapData(MapData::O_FLOOR)
+					&& tile->getMapData(MapData::O_FLOOR)->getLightSource())
+				{
+					sources.push_back(LightSource(pos.x, pos.y, tile->getMapData(MapData::O_FLOOR)->getLightSource()));
+				}
+				if (tile->getMapData(MapData::O_OBJECT)
+					&& tile->getMapData(MapData::O_OBJECT)->getLightSource())
+				{
+					sources.push_back(LightSource(pos.x, pos.y, tile->getMapData(MapData::O_OBJECT)->getLightSource()));
+				}
 
-		for (std::vector<BattleItem*>::iterator it = _save->getTiles()[i]->getInventory()->begin(); it != _save->getTiles()[i]->getInventory()->end(); ++it)
-		{
-			if ((*it)->getRules()->getBattleType() == BT_FLARE)
-			{
-				addLight(_save->getTiles()[i]->getPosition(), (*it)->getRules()->getPower(), layer);
+				// fires
+				if (tile->getFire())
+				{
+					sources.push_back(LightSource(pos.x, pos.y, fireLightPower));
+				}
+
+				for (std::vector<BattleItem*>::iterator it = tile->getInventory()->begin(); it != tile->getInventory()->end(); ++it)
+				{
+					if ((*it)->getRules()->getBattleType() == BT_FLARE)
+					{
+						sources.push_back(LightSource(pos.x, pos.y, (*it)->getRules()->getPower()));
+					}
+				}
 			}
 		}
-
 	}
 
+	_lightField->setSources(layer, x0, y0, x1, y1, sources);
 }
 
 /**
@@ -144,14 +198,10 @@ void TileEngine::calculateTerrainLighting()
   */
 void TileEngine::calculateUnitLighting()
 {
+	PhaseTimer timer(PhaseTimer::PHASE_LIGHTING);
 	const int layer = 2; // Dynamic lighting layer.
 	const int personalLightPower = 15; // amount of light a unit generates
-
-	// reset all light to 0 first
-	for (int i = 0; i < _save->getWidth() * _save->getLength() * _save->getHeight(); ++i)
-	{
-		_save->getTiles()[i]->resetLight(layer);
-	}
+	std::vector<LightSource> sources;
 
 	if (_personalLighting)
 	{
@@ -160,60 +210,160 @@ void TileEngine::calculateUnitLighting()
 		{
 			if ((*i)->getFaction() == FACTION_PLAYER && !(*i)->isOut())
 			{
-				addLight((*i)->getPosition(), personalLightPower, layer);
+				sources.push_back(LightSource((*i)->getPosition().x, (*i)->getPosition().y, personalLightPower));
 			}
 		}
 	}
+
+	_lightField->setSources(layer, sources);
 }
 
+
 /**
- * Adds circular light pattern starting from center and loosing power with distance travelled.
- * @param center
- * @param power
- * @param layer Light is seperated in 3 layers: Ambient, Static and Dynamic.
+ * Calculates line of sight of a soldier.
+ * Units are looked up around the unit instead of scanning every tile of the view cone,
+ * and the visible tiles of a player unit are only rescanned when it moved or the terrain
+ * around it changed. When it only turned, just the part of the new view cone that wasn't
+ * in the old one is traced.
+ * @param unit
+ * @return true when new aliens spotted
  */
-void TileEngine::addLight(const Position &center, int power, int layer)
+bool TileEngine::calculateFOV(BattleUnit *unit)
+{
+	PhaseTimer timer(PhaseTimer::PHASE_FOV);
+	FOVResult result;
+	result.unit = unit;
+	findFOV(&result);
+	return applyFOV(result);
+}
+
+/**
+ * Calculates line of sight of several units, like at the start of a turn.
+ * Finding out what each unit sees doesn't change the battlescape, so that part is spread over
+ * a number of threads. The results are then applied one unit after the other in the order given,
+ * so the outcome is the same as calculating the units one by one, whatever the number of threads.
+ * @param units The units to calculate the field of view of.
+ */
+void TileEngine::calculateFOV(const std::vector<BattleUnit*> &units)
 {
-	// only loop through the positive quadrant.
-	for (int x = 0; x <= power; ++x)
+	PhaseTimer timer(PhaseTimer::PHASE_FOV);
+	std::vector<FOVResult> results(units.size());
+	for (size_t i = 0; i < units.size(); ++i)
 	{
-		for (int y = 0; y <= power; ++y)
-		{
-			for (int z = 0; z < _save->getHeight(); z++)
-			{
-				int distance = int(floor(sqrt(float(x*x + y*y)) + 0.5));
+		results[i].unit = units[i];
+	}
 
-				if (_save->getTile(Position(center.x + x,center.y + y, z)))
-					_save->getTile(Position(center.x + x,center.y + y, z))->addLight(power - distance, layer);
+	// the unit grid registers new units when first asked, make sure that's not happening in the threads
+	_save->getUnitGrid()->update();
 
-				if (_save->getTile(Position(center.x - x,center.y - y, z)))
-					_save->getTile(Position(center.x - x,center.y - y, z))->addLight(power - distance, layer);
+	runThreads(&TileEngine::findFOV, &results, results.size());
 
-				if (_save->getTile(Position(center.x - x,center.y + y, z)))
-					_save->getTile(Position(center.x - x,center.y + y, z))->addLight(power - distance, layer);
+	for (std::vector<FOVResult>::iterator i = results.begin(); i != results.end(); ++i)
+	{
+		applyFOV(*i);
+	}
+}
 
-				if (_save->getTile(Position(center.x + x,center.y - y, z)))
-					_save->getTile(Position(center.x + x,center.y - y, z))->addLight(power - distance, layer);
-			}
+/**
+ * Spreads a job over a number of threads, like one per processor.
+ * The job must not change anything that other items of the job look at.
+ * @param job The function to call for every item.
+ * @param data The data the job works on.
+ * @param count The number of items.
+ */
+void TileEngine::runThreads(void (TileEngine::*job)(void *data, size_t item), void *data, size_t count)
+{
+	int threadCount = Options::getInt("battleThreads");
+	if (threadCount <= 0)
+	{
+		threadCount = CrossPlatform::getProcessorCount();
+	}
+	threadCount = std::max(1, (int)std::min((size_t)threadCount, count));
+
+	std::vector<WorkerThread> work(threadCount);
+	std::vector<SDL_Thread*> threads;
+	for (int i = 0; i < threadCount; ++i)
+	{
+		work[i].engine = this;
+		work[i].job = job;
+		work[i].data = data;
+		work[i].first = i;
+		work[i].step = threadCount;
+		work[i].count = count;
+	}
+	for (int i = 1; i < threadCount; ++i)
+	{
+		SDL_Thread *thread = SDL_CreateThread(runWorkerThread, &work[i]);
+		if (thread)
+		{
+			threads.push_back(thread);
+		}
+		else
+		{
+			runWorkerThread(&work[i]);
 		}
 	}
+	runWorkerThread(&work[0]);
+	for (std::vector<SDL_Thread*>::iterator i = threads.begin(); i != threads.end(); ++i)
+	{
+		SDL_WaitThread(*i, 0);
+	}
+}
+
+/**
+ * Does the share of a job of one thread.
+ * @param data Pointer to the WorkerThread with the work of this thread.
+ * @return 0
+ */
+int TileEngine::runWorkerThread(void *data)
+{
+	WorkerThread *work = (WorkerThread*)data;
+	for (size_t i = work->first; i < work->count; i += work->step)
+	{
+		(work->engine->*work->job)(work->data, i);
+	}
+	return 0;
 }
 
+/**
+ * Finds out which units and tiles one of a list of units sees.
+ * @param data Pointer to the vector of FOV results.
+ * @param item Index of the FOV result to fill in.
+ */
+void TileEngine::findFOV(void *data, size_t item)
+{
+	findFOV(&(*(std::vector<FOVResult>*)data)[item]);
+}
 
 /**
- * Calculates line of sight of a soldier.
- * @param unit
+ * Finds out which units and tiles a unit sees, without changing anything on the battlescape.
+ * @param result The FOV result to fill in, with the unit already set.
+ */
+void TileEngine::findFOV(FOVResult *result)
+{
+	result->units.clear();
+	result->tiles.clear();
+	result->tileMode = FOV_TILES_UNCHANGED;
+
+	if (result->unit->isOut())
+		return;
+
+	findVisibleUnits(result->unit, &result->units);
+	if (result->unit->getFaction() == FACTION_PLAYER)
+	{
+		result->tileMode = findVisibleTiles(result->unit, &result->tiles);
+	}
+}
+
+/**
+ * Applies what a unit sees: the visible units and tiles, and what the unit does about it.
+ * @param result The FOV result of the unit.
  * @return true when new aliens spotted
  */
-bool TileEngine::calculateFOV(BattleUnit *unit)
+bool TileEngine::applyFOV(const FOVResult &result)
 {
+	BattleUnit *unit = result.unit;
 	size_t visibleUnitsChecksum = 0, oldNumVisibleUnits = 0;
-	Position center = unit->getPosition();
-	Position test;
-	bool swap = (unit->getDirection()==0 || unit->getDirection()==4);
-	int signX[8] = { +1, +1, +1, +1, -1, -1, -1, -1 };
-	int signY[8] = { -1, -1, -1, +1, +1, +1, -1, -1 };
-	int y1, y2;
 
 	// calculate a visible units checksum - if it changed during this step, the soldier stops walking
 	// the unit's Xposition * 100 + y seems a simple but unique ID for each unit
@@ -223,66 +373,33 @@ bool TileEngine::calculateFOV(BattleUnit *unit)
 	oldNumVisibleUnits = unit->getVisibleUnits()->size();
 
 	unit->clearVisibleUnits();
-	unit->clearVisibleTiles();
 
 	if (unit->isOut())
+	{
+		unit->clearVisibleTiles();
 		return false;
+	}
 
-	for (int x = 0; x <= MAX_VIEW_DISTANCE; ++x)
+	for (std::vector<BattleUnit*>::const_iterator i = result.units.begin(); i != result.units.end(); ++i)
 	{
-		if (unit->getDirection()%2)
+		if (((*i)->getFaction() == FACTION_HOSTILE && unit->getFaction() != FACTION_HOSTILE)
+			|| ((*i)->getFaction() != FACTION_HOSTILE && unit->getFaction() == FACTION_HOSTILE))
 		{
-			y1 = 0;
-			y2 = MAX_VIEW_DISTANCE - x;
+			unit->addToVisibleUnits(*i);
+			if (unit->getFaction() == _save->getSide() && _save->getSide() != FACTION_PLAYER)
+				_save->getThreatMap()->addWatcher(*i);
 		}
-		else
-		{
-			y1 = -x;
-			y2 = x;
-		}
-		for (int y = y1; y <= y2; ++y)
-		{
-			for (int z = 0; z < _save->getHeight(); z++)
-			{
-				int distance = int(floor(sqrt(float(x*x + y*y)) + 0.5));
-				test.z = z;
-				if (distance <= MAX_VIEW_DISTANCE)
-				{
-					test.x = center.x + signX[unit->getDirection()]*(swap?y:x);
-					test.y = center.y + signY[unit->getDirection()]*(swap?x:y);
-					if (_save->getTile(test))
-					{
-						BattleUnit *visibleUnit = _save->getTile(test)->getUnit();
-						if (visibleUnit && !visibleUnit->isOut() && visible(unit, _save->getTile(test)))
-						{
-							if ((visibleUnit->getFaction() == FACTION_HOSTILE && unit->getFaction() != FACTION_HOSTILE)
-								|| (visibleUnit->getFaction() != FACTION_HOSTILE && unit->getFaction() == FACTION_HOSTILE))
-							{
-								unit->addToVisibleUnits(visibleUnit);
-							}
-							if (unit->getFaction() == FACTION_PLAYER)
-								visibleUnit->setVisible(true);
-						}
+		if (unit->getFaction() == FACTION_PLAYER)
+			(*i)->setVisible(true);
+	}
 
-						if (unit->getFaction() == FACTION_PLAYER)
-						{
-							// this sets tiles to discovered if they are in LOS - tile visibility is not calculated in voxelspace but in tilespace
-							if (calculateLine(unit->getPosition(), test, false, 0, unit, false) <= 0)
-							{
-								unit->addToVisibleTiles(_save->getTile(test));
-								_save->getTile(test)->setDiscovered(true, 2);
-								_save->getTile(test)->setVisible(+1);
-								// walls to the east or south of a visible tile, we see that too
-								Tile* t = _save->getTile(Position(test.x + 1, test.y, test.z));
-								if (t) t->setDiscovered(true, 0);
-								t = _save->getTile(Position(test.x, test.y + 1, test.z));
-								if (t) t->setDiscovered(true, 1);
-							}
-						}
-					}
-				}
-			}
-		}
+	if (unit->getFaction() == FACTION_PLAYER)
+	{
+		applyVisibleTiles(unit, result.tileMode, result.tiles);
+	}
+	else
+	{
+		unit->clearVisibleTiles();
 	}
 
 	size_t newChecksum = 0;
@@ -313,6 +430,415 @@ bool TileEngine::calculateFOV(BattleUnit *unit)
 
 }
 
+/**
+ * A node of the ray fan while it is being built.
+ */
+struct RayFanBuildNode
+{
+	Position pos;
+	int depth, coneMask, targetMask;
+	std::vector<int> children;
+};
+
+/**
+ * Builds the ray fan used for tile visibility. The fan is a tree of all tilespace lines
+ * calculateLine draws from a unit to the tiles it can possibly see: lines sharing their first steps
+ * share their nodes, so each step is checked for blockage only once per FOV calculation.
+ * The nodes are stored depth first, each node knowing where its subtree ends.
+ */
+void TileEngine::buildRayFan()
+{
+	std::vector<RayFanBuildNode> tree(1);
+	tree[0].pos = Position(0, 0, 0);
+	tree[0].depth = 0;
+	tree[0].coneMask = tree[0].targetMask = 0;
+
+	for (int tz = 1 - _save->getHeight(); tz < _save->getHeight(); ++tz)
+	{
+		for (int tx = -MAX_VIEW_DISTANCE; tx <= MAX_VIEW_DISTANCE; ++tx)
+		{
+			for (int ty = -MAX_VIEW_DISTANCE; ty <= MAX_VIEW_DISTANCE; ++ty)
+			{
+				Position target(tx, ty, tz);
+				int targetMask = 0;
+				for (int dir = 0; dir < 8; ++dir)
+				{
+					if (inViewCone(Position(0, 0, 0), dir, target, 0))
+						targetMask |= 1 << dir;
+				}
+				if (!targetMask)
+					continue;
+
+				// the same bresenham line as calculateLine, from the origin to the target
+				int x0 = 0, y0 = 0, z0 = 0, x1 = tx, y1 = ty, z1 = tz;
+				bool swap_xy = abs(y1 - y0) > abs(x1 - x0);
+				if (swap_xy)
+				{
+					std::swap(x0, y0);
+					std::swap(x1, y1);
+				}
+				bool swap_xz = abs(z1 - z0) > abs(x1 - x0);
+				if (swap_xz)
+				{
+					std::swap(x0, z0);
+					std::swap(x1, z1);
+				}
+				int delta_x = abs(x1 - x0), delta_y = abs(y1 - y0), delta_z = abs(z1 - z0);
+				int drift_xy = delta_x / 2, drift_xz = delta_x / 2;
+				int step_x = x0 > x1 ? -1 : 1, step_y = y0 > y1 ? -1 : 1, step_z = z0 > z1 ? -1 : 1;
+				int y = y0, z = z0;
+				int node = 0;
+
+				for (int x = x0 + step_x; x != (x1 + step_x); x += step_x)
+				{
+					drift_xy = drift_xy - delta_y;
+					drift_xz = drift_xz - delta_z;
+					if (drift_xy < 0)
+					{
+						y = y + step_y;
+						drift_xy = drift_xy + delta_x;
+					}
+					if (drift_xz < 0)
+					{
+						z = z + step_z;
+						drift_xz = drift_xz + delta_x;
+					}
+
+					int cx = x, cy = y, cz = z;
+					if (swap_xz) std::swap(cx, cz);
+					if (swap_xy) std::swap(cx, cy);
+					Position step(cx, cy, cz);
+
+					int child = -1;
+					for (std::vector<int>::iterator i = tree[node].children.begin(); i != tree[node].children.end(); ++i)
+					{
+						if (tree[*i].pos == step)
+						{
+							child = *i;
+							break;
+						}
+					}
+					if (child == -1)
+					{
+						child = tree.size();
+						tree.push_back(RayFanBuildNode());
+						tree[child].pos = step;
+						tree[child].depth = tree[node].depth + 1;
+						tree[child].coneMask = tree[child].targetMask = 0;
+						tree[node].children.push_back(child);
+					}
+					tree[node].coneMask |= targetMask;
+					node = child;
+				}
+				tree[node].coneMask |= targetMask;
+				tree[node].targetMask |= targetMask;
+			}
+		}
+	}
+
+	// flatten the tree depth first
+	_rayFan.clear();
+	_rayFan.reserve(tree.size());
+	std::vector<std::pair<int, size_t> > stack; // tree node, index of its first child still to do
+	stack.push_back(std::make_pair(0, size_t(0)));
+	std::vector<size_t> flat; // index in _rayFan of each node on the stack
+	while (!stack.empty())
+	{
+		RayFanBuildNode &current = tree[stack.back().first];
+		if (stack.back().second == 0)
+		{
+			RayFanNode node;
+			node.x = current.pos.x;
+			node.y = current.pos.y;
+			node.z = current.pos.z;
+			node.depth = current.depth;
+			node.coneMask = current.coneMask;
+			node.targetMask = current.targetMask;
+			node.next = 0;
+			flat.push_back(_rayFan.size());
+			_rayFan.push_back(node);
+		}
+		if (stack.back().second < current.children.size())
+		{
+			int child = current.children[stack.back().second++];
+			stack.push_back(std::make_pair(child, size_t(0)));
+		}
+		else
+		{
+			_rayFan[flat.back()].next = _rayFan.size();
+			flat.pop_back();
+			stack.pop_back();
+		}
+	}
+}
+
+/**
+ * Checks if a position is inside the view cone of a unit looking in a certain direction.
+ * The view cone is scanned column by column, away from the unit, then row by row and level by level.
+ * @param origin The position of the unit.
+ * @param direction The direction the unit is facing.
+ * @param position The position to check.
+ * @param scanOrder If not null, receives the order in which the cone scan visits the position.
+ * @return Whether the position is in the view cone.
+ */
+bool TileEngine::inViewCone(const Position &origin, int direction, const Position &position, int *scanOrder) const
+{
+	static const int signX[8] = { +1, +1, +1, +1, -1, -1, -1, -1 };
+	static const int signY[8] = { -1, -1, -1, +1, +1, +1, -1, -1 };
+	bool swap = (direction == 0 || direction == 4);
+	int x, y;
+
+	// this is the inverse of the mapping from view cone to map coordinates
+	if (swap)
+	{
+		x = (position.y - origin.y) * signY[direction];
+		y = (position.x - origin.x) * signX[direction];
+	}
+	else
+	{
+		x = (position.x - origin.x) * signX[direction];
+		y = (position.y - origin.y) * signY[direction];
+	}
+
+	if (x < 0 || x > MAX_VIEW_DISTANCE)
+		return false;
+	if (direction%2 ? (y < 0 || y > MAX_VIEW_DISTANCE - x) : (y < -x || y > x))
+		return false;
+	if (int(floor(sqrt(float(x*x + y*y)) + 0.5)) > MAX_VIEW_DISTANCE)
+		return false;
+
+	if (scanOrder)
+	{
+		*scanOrder = ((x * (2 * MAX_VIEW_DISTANCE + 1)) + (y + MAX_VIEW_DISTANCE)) * _save->getHeight() + position.z;
+	}
+	return true;
+}
+
+/**
+ * Finds the units seen by a unit. Only tiles occupied by a unit inside the view cone are checked,
+ * in the same order as a scan of the whole view cone would encounter them.
+ * @param unit The watching unit.
+ * @param units Receives the units seen, whatever their faction.
+ */
+void TileEngine::findVisibleUnits(BattleUnit *unit, std::vector<BattleUnit*> *units)
+{
+	std::vector<std::pair<int, Tile*> > candidates;
+	int scanOrder;
+
+	// large units can stand just outside the range with their other tiles inside it
+	std::vector<BattleUnit*> nearby;
+	_save->getUnitGrid()->getUnits(unit->getPosition(), MAX_VIEW_DISTANCE + 1, &nearby);
+	for (std::vector<BattleUnit*>::iterator i = nearby.begin(); i != nearby.end(); ++i)
+	{
+		if ((*i)->isOut())
+			continue;
+
+		int size = (*i)->getArmor()->getSize();
+		for (int x = 0; x < size; ++x)
+		{
+			for (int y = 0; y < size; ++y)
+			{
+				Tile *tile = _save->getTile((*i)->getPosition() + Position(x, y, 0));
+				if (tile && tile->getUnit() == (*i) && inViewCone(unit->getPosition(), unit->getDirection(), tile->getPosition(), &scanOrder))
+				{
+					candidates.push_back(std::make_pair(scanOrder, tile));
+				}
+			}
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	for (std::vector<std::pair<int, Tile*> >::iterator i = candidates.begin(); i != candidates.end(); ++i)
+	{
+		BattleUnit *visibleUnit = i->second->getUnit();
+		// once a unit is seen, its other tiles can't tell us anything new
+		if (std::find(units->begin(), units->end(), visibleUnit) != units->end())
+			continue;
+
+		if (visible(unit, i->second))
+		{
+			units->push_back(visibleUnit);
+		}
+	}
+}
+
+/**
+ * Finds the tiles seen by a unit.
+ * Tile visibility only depends on the terrain, so the previous result is reused when the unit
+ * hasn't moved and no terrain within view range has changed since (see invalidateTerrain).
+ * A move traces the whole view cone again: every line of sight starts in the tile the unit
+ * stepped into, so none of the old ones still hold. Of the 1371 lines of a cone facing east,
+ * only the 4 along the step run over the same tiles after a step east.
+ * @param unit The watching unit.
+ * @param tiles Receives the tiles seen that aren't in the unit's visible tiles yet.
+ * @return FOV_TILES_UNCHANGED when the visible tiles are still valid, FOV_TILES_ALL when they
+ * have to be replaced, or the direction the unit turned from when the new tiles should be added to them.
+ */
+int TileEngine::findVisibleTiles(BattleUnit *unit, std::vector<Tile*> *tiles)
+{
+	Position cachedPosition;
+	int cachedDirection;
+	bool cached = unit->getFOVCache(&cachedPosition, &cachedDirection);
+	int skipDirection = -1;
+
+	if (cached && cachedPosition == unit->getPosition())
+	{
+		if (cachedDirection == unit->getDirection())
+			return FOV_TILES_UNCHANGED;
+		// the unit turned: the tiles still in the view cone are already known
+		skipDirection = cachedDirection;
+	}
+
+	// walk the ray fan: a subtree is skipped as soon as its common line of sight is blocked
+	const Position center = unit->getPosition();
+	const int coneBit = 1 << unit->getDirection();
+	const int skipBit = skipDirection == -1 ? 0 : 1 << skipDirection;
+	Tile *path[MAX_VIEW_DISTANCE + 1];
+
+	for (size_t i = 0; i < _rayFan.size(); )
+	{
+		const RayFanNode &node = _rayFan[i];
+		if (!(node.coneMask & coneBit))
+		{
+			i = node.next;
+			continue;
+		}
+		Tile *tile = _save->getTile(center + Position(node.x, node.y, node.z));
+		if (!tile)
+		{
+			// if this point is off the map, so are all targets behind it
+			i = node.next;
+			continue;
+		}
+		// this is the blockage check calculateLine does in tilespace for every step
+		Tile *last = node.depth ? path[node.depth - 1] : tile;
+		if (horizontalBlockage(last, tile, DT_NONE) + verticalBlockage(last, tile, DT_NONE) > 127)
+		{
+			i = node.next;
+			continue;
+		}
+		path[node.depth] = tile;
+
+		if ((node.targetMask & coneBit) && !(node.targetMask & skipBit))
+		{
+			tiles->push_back(tile);
+		}
+		++i;
+	}
+
+	return skipDirection == -1 ? (int)FOV_TILES_ALL : skipDirection;
+}
+
+/**
+ * Finds the tiles a unit could see units on if it turned to face them: the tiles of the
+ * view cones in all directions that are bright enough to see a unit in.
+ * The lines of sight are those of the ray fan, as for the visible tiles.
+ * @param unit The watching unit.
+ * @param tiles Receives the tiles.
+ */
+void TileEngine::findExposedTiles(BattleUnit *unit, std::vector<Tile*> *tiles)
+{
+	const Position center = unit->getPosition();
+	Tile *path[MAX_VIEW_DISTANCE + 1];
+
+	for (size_t i = 0; i < _rayFan.size(); )
+	{
+		const RayFanNode &node = _rayFan[i];
+		Tile *tile = _save->getTile(center + Position(node.x, node.y, node.z));
+		if (!tile)
+		{
+			i = node.next;
+			continue;
+		}
+		Tile *last = node.depth ? path[node.depth - 1] : tile;
+		if (horizontalBlockage(last, tile, DT_NONE) + verticalBlockage(last, tile, DT_NONE) > 127)
+		{
+			i = node.next;
+			continue;
+		}
+		path[node.depth] = tile;
+
+		if (node.targetMask && tile->getShade() <= MAX_DARKNESS_TO_SEE_UNITS)
+		{
+			tiles->push_back(tile);
+		}
+		++i;
+	}
+}
+
+/**
+ * Updates the visible tiles of a unit and marks them discovered.
+ * @param unit The watching unit.
+ * @param tileMode How to update the visible tiles, see findVisibleTiles.
+ * @param tiles The tiles found by findVisibleTiles.
+ */
+void TileEngine::applyVisibleTiles(BattleUnit *unit, int tileMode, const std::vector<Tile*> &tiles)
+{
+	if (tileMode == FOV_TILES_UNCHANGED)
+		return;
+
+	if (tileMode == FOV_TILES_ALL)
+	{
+		unit->clearVisibleTiles();
+	}
+	else
+	{
+		// the unit turned: forget the tiles that left the view cone, keep the ones still in it
+		std::vector<Tile*> *visibleTiles = unit->getVisibleTiles();
+		std::vector<Tile*>::iterator kept = visibleTiles->begin();
+		for (std::vector<Tile*>::iterator i = visibleTiles->begin(); i != visibleTiles->end(); ++i)
+		{
+			if (inViewCone(unit->getPosition(), unit->getDirection(), (*i)->getPosition(), 0))
+			{
+				*kept++ = *i;
+			}
+			else
+			{
+				(*i)->setVisible(-1);
+			}
+		}
+		visibleTiles->erase(kept, visibleTiles->end());
+	}
+
+	for (std::vector<Tile*>::const_iterator i = tiles.begin(); i != tiles.end(); ++i)
+	{
+		unit->addToVisibleTiles(*i);
+		(*i)->setDiscovered(true, 2);
+		(*i)->setVisible(+1);
+		// walls to the east or south of a visible tile, we see that too
+		Tile* t = _save->getTile((*i)->getPosition() + Position(1, 0, 0));
+		if (t) t->setDiscovered(true, 0);
+		t = _save->getTile((*i)->getPosition() + Position(0, 1, 0));
+		if (t) t->setDiscovered(true, 1);
+	}
+
+	unit->setFOVCache(true);
+}
+
+/**
+ * Marks the terrain at a position as changed, so the visible tiles of units that could
+ * look over or through it are fully recalculated the next time.
+ * Its roof could have been destroyed, so the sun shading of its column is updated as well,
+ * and so are the merged terrain voxels of the tile and the moves around it.
+ * @param position The tile whose terrain changed.
+ */
+void TileEngine::invalidateTerrain(const Position &position)
+{
+	calculateSunShading(position.x, position.y);
+	calculateVoxelPlanes(_save->getTile(position));
+	_save->getPathfinding()->invalidateTerrain(position);
+
+	for (std::vector<BattleUnit*>::iterator i = _save->getUnits()->begin(); i != _save->getUnits()->end(); ++i)
+	{
+		// lines of sight pass at most a tile beside the cone, and tiles next to a visible tile get discovered too
+		if (distance(position, (*i)->getPosition()) <= MAX_VIEW_DISTANCE + 2)
+		{
+			(*i)->setFOVCache(false);
+		}
+	}
+}
+
 
 /**
  * Check for an opposing unit on this tile
@@ -328,13 +854,23 @@ bool TileEngine::visible(BattleUnit *currentUnit, Tile *tile)
 		return false;
 	}
 
+	// smoke can only shorten the view distance, so if the smoke we're standing in already makes it too far, don't bother tracing
+	Tile *t = _save->getTile(currentUnit->getPosition());
+	int maxViewDistance = MAX_VIEW_DISTANCE - (t->getSmoke()/2);
+	int targetDistance = distance(currentUnit->getPosition(), tile->getPosition());
+	if (targetDistance > maxViewDistance)
+	{
+		return false;
+	}
+
 	// determine the origin and target voxels for the raytrace
 	Position originVoxel, targetVoxel;
 	std::vector<Position> _trajectory;
 	originVoxel = Position((currentUnit->getPosition().x * 16) + 8, (currentUnit->getPosition().y * 16) + 8, currentUnit->getPosition().z*24);
-	originVoxel.z += -_save->getTile(currentUnit->getPosition())->getTerrainLevel();
+	originVoxel.z += -t->getTerrainLevel();
 	originVoxel.z += currentUnit->getHeight();
 	bool unitSeen = false;
+	int smoke = 0;
 
 	targetVoxel = Position((tile->getPosition().x * 16) + 8, (tile->getPosition().y * 16) + 8, tile->getPosition().z*24);
 	int targetMinHeight = targetVoxel.z - tile->getTerrainLevel();
@@ -350,12 +886,13 @@ bool TileEngine::visible(BattleUnit *currentUnit, Tile *tile)
 		targetMaxHeight += 12;
 	}
 
-	// scan ray from top to bottom
+	// scan ray from top to bottom, adding up the smoke along each ray so the one that makes it doesn't need another trace
 	for (int i = targetMaxHeight; i > targetMinHeight; i-=2)
 	{
 		targetVoxel.z = i;
 		_trajectory.clear();
-		int test = calculateLine(originVoxel, targetVoxel, false, &_trajectory, currentUnit);
+		smoke = 0;
+		int test = calculateLine(originVoxel, targetVoxel, false, &_trajectory, currentUnit, true, &smoke);
 		if (test == 4)
 		{
 			Position hitPosition = Position(_trajectory.at(0).x/16, _trajectory.at(0).y/16, _trajectory.at(0).z/24);
@@ -377,19 +914,14 @@ bool TileEngine::visible(BattleUnit *currentUnit, Tile *tile)
 		// now check if we really see it taking into account smoke tiles
 		// initial smoke "density" of a smoke grenade is around 10 per tile
 		// we do density/2 to get the decay of visibility, so in fresh smoke we only have 4 tiles of visibility
-		_trajectory.clear();
-		calculateLine(originVoxel, targetVoxel, true, &_trajectory, currentUnit);
-		Tile *t = _save->getTile(currentUnit->getPosition());
-		int maxViewDistance = MAX_VIEW_DISTANCE - (t->getSmoke()/2);
-		for (unsigned int i = 0; i < _trajectory.size(); i++)
+		// the line doesn't count the tile it starts in, which is not ours when we stand high enough to look out of it
+		Tile *originTile = _save->getTile(Position(originVoxel.x/16, originVoxel.y/16, originVoxel.z/24));
+		if (originTile != t)
 		{
-			if (t != _save->getTile(Position(_trajectory.at(i).x/16,_trajectory.at(i).y/16, _trajectory.at(i).z/24)))
-			{
-				t = _save->getTile(Position(_trajectory.at(i).x/16,_trajectory.at(i).y/16, _trajectory.at(i).z/24));
-				maxViewDistance -= t->getSmoke()/2;
-			}
+			maxViewDistance -= originTile->getSmoke()/2;
 		}
-		if (distance(currentUnit->getPosition(), tile->getPosition()) <= maxViewDistance)
+		maxViewDistance -= smoke;
+		if (targetDistance <= maxViewDistance)
 		{
 			unitSeen = true;
 		}
@@ -408,7 +940,10 @@ bool TileEngine::visible(BattleUnit *currentUnit, Tile *tile)
  */
 void TileEngine::calculateFOV(const Position &position)
 {
-	for (std::vector<BattleUnit*>::iterator i = _save->getUnits()->begin(); i != _save->getUnits()->end(); ++i)
+	PhaseTimer timer(PhaseTimer::PHASE_FOV);
+	std::vector<BattleUnit*> units;
+	_save->getUnitGrid()->getUnits(position, MAX_VIEW_DISTANCE, &units);
+	for (std::vector<BattleUnit*>::iterator i = units.begin(); i != units.end(); ++i)
 	{
 		if (distance(position, (*i)->getPosition()) < 20 && (*i)->getFaction() == _save->getSide())
 		{
@@ -427,6 +962,7 @@ void TileEngine::calculateFOV(const Position &position)
  */
 bool TileEngine::checkReactionFire(BattleUnit *unit, BattleAction *action, BattleUnit *potentialVictim, bool recalculateFOV)
 {
+	PhaseTimer timer(PhaseTimer::PHASE_REACTION_FIRE);
 	double highestReactionScore = 0;
 	action->actor = 0;
 
@@ -461,7 +997,9 @@ bool TileEngine::checkReactionFire(BattleUnit *unit, BattleAction *action, Battl
 	// we reset the unit to false here - if it is seen by any unit in range below the unit becomes visible again
 	//unit->setVisible(false);
 
-	for (std::vector<BattleUnit*>::iterator i = _save->getUnits()->begin(); i != _save->getUnits()->end(); ++i)
+	std::vector<BattleUnit*> spotters;
+	_save->getUnitGrid()->getUnits(unit->getPosition(), 19, &spotters);
+	for (std::vector<BattleUnit*>::iterator i = spotters.begin(); i != spotters.end(); ++i)
 	{
 		if (distance(unit->getPosition(), (*i)->getPosition()) < 19 && (*i)->getFaction() != _save->getSide() && !(*i)->isOut())
 		{
@@ -529,6 +1067,7 @@ BattleUnit *TileEngine::hit(const Position &center, int power, ItemDamageType ty
 		// power 25% to 75%
 		int rndPower = RNG::generate(power/4, (power*3)/4); //RNG::boxMuller(power, power/6)
 		tile->damage(part, rndPower);
+		invalidateTerrain(tile->getPosition());
 	}
 	else if (part == 4)
 	{
@@ -565,9 +1104,9 @@ BattleUnit *TileEngine::hit(const Position &center, int power, ItemDamageType ty
 		}
 	}
 	applyItemGravity(tile);
-	calculateSunShading(); // roofs could have been destroyed
-	calculateFOV(center);
-	calculateTerrainLighting(); // fires could have been started
+	calculateFOV(tile->getPosition());
+	// fires could have been started, a lamp destroyed or a flare dropped, but only in this column
+	calculateTerrainLighting(tile->getPosition().x, tile->getPosition().y, tile->getPosition().x, tile->getPosition().y);
 	return bu;
 }
 
@@ -583,133 +1122,202 @@ BattleUnit *TileEngine::hit(const Position &center, int power, ItemDamageType ty
  */
 void TileEngine::explode(const Position &center, int power, ItemDamageType type, int maxRadius, BattleUnit *unit)
 {
-	double centerZ = (int)(center.z / 24) + 0.5;
-	double centerX = (int)(center.x / 16) + 0.5;
-	double centerY = (int)(center.y / 16) + 0.5;
-	int power_;
-	std::set<Tile*> tilesAffected;
-	std::pair<std::set<Tile*>::iterator,bool> ret;
-
 	if (type == DT_IN)
 	{
 		power /= 2;
 	}
 
-	for (int fi = -90; fi <= 90; fi += 10)
+	// first trace all rays, which doesn't change anything on the map, so they can go in parallel
+	Explosion explosion;
+	explosion.center = center;
+	explosion.power = power;
+	explosion.type = type;
+	explosion.maxRadius = std::max(maxRadius, -1);
+	explosion.hits.resize(BLAST_RAYS * (explosion.maxRadius + 1));
+	explosion.hitCounts.resize(BLAST_RAYS, 0);
+	if (explosion.maxRadius >= 0)
 	{
-		// raytrace every 3 degrees makes sure we cover all tiles in a circle.
-		for (int te = 0; te <= 360; te += 3)
-		{
-			double cos_te = cos(te * M_PI / 180.0);
-			double sin_te = sin(te * M_PI / 180.0);
-			double sin_fi = sin(fi * M_PI / 180.0);
-
-			Tile *origin = _save->getTile(center);
-			double l = 0;
-			double vx, vy, vz;
-			int tileX, tileY, tileZ;
-			power_ = power + 1;
-
-			while (power_ > 0 && l <= maxRadius)
-			{
-				vx = centerX + l * cos_te;
-				vy = centerY + l * sin_te;
-				vz = centerZ + (l / 2.0) * sin_fi;
+		buildBlastRays(explosion.maxRadius + 1);
+		runThreads(&TileEngine::propagateExplosion, &explosion, BLAST_RAYS);
+	}
 
-				tileZ = int(floor(vz));
-				tileX = int(floor(vx));
-				tileY = int(floor(vy));
+	// then apply them ray by ray in a fixed order, so the random damage always comes out the same
+	std::vector<bool> affected(_save->getWidth() * _save->getLength() * _save->getHeight(), false);
+	std::vector<int> tilesAffected;
+	int minX = _save->getWidth(), minY = _save->getLength(), maxX = -1, maxY = -1;
 
-				Tile *dest = _save->getTile(Position(tileX, tileY, tileZ));
-				if (!dest) break; // out of map!
+	for (int ray = 0; ray < BLAST_RAYS; ++ray)
+	{
+		for (int i = 0; i < explosion.hitCounts[ray]; ++i)
+		{
+			const BlastHit &hit = explosion.hits[ray * (explosion.maxRadius + 1) + i];
+			Tile *dest = hit.tile;
+			int power_ = hit.power;
 
-				// horizontal blockage by walls
-				power_ -= (horizontalBlockage(origin, dest, type) + verticalBlockage(origin, dest, type));
+			if (type == DT_HE)
+			{
+				// explosives do 1/2 damage to terrain and 1/2 up to 3/2 random damage to units
+				dest->setExplosive(power_ / 2);
+			}
 
-				if (power_ > 0)
+			int index = _save->getTileIndex(dest->getPosition());
+			if (affected[index]) // check if we had this tile already
+				continue;
+			affected[index] = true;
+			tilesAffected.push_back(index);
+			minX = std::min(minX, dest->getPosition().x);
+			minY = std::min(minY, dest->getPosition().y);
+			maxX = std::max(maxX, dest->getPosition().x);
+			maxY = std::max(maxY, dest->getPosition().y);
+
+			if (type == DT_HE || type == DT_STUN)
+			{
+				// power 50 - 150%
+				if (dest->getUnit())
 				{
-					if (type == DT_HE)
-					{
-						// explosives do 1/2 damage to terrain and 1/2 up to 3/2 random damage to units
-						dest->setExplosive(power_ / 2);
-					}
-
-					ret = tilesAffected.insert(dest); // check if we had this tile already
-					if (ret.second)
+					dest->getUnit()->damage(Position(0, 0, 0), (int)(RNG::generate(power_/2.0, power_*1.5)), type);
+				}
+				bool done = false;
+				while (!done)
+				{
+					done = dest->getInventory()->size() == 0;
+					for (std::vector<BattleItem*>::iterator it = dest->getInventory()->begin(); it != dest->getInventory()->end(); )
 					{
-						if (type == DT_HE || type == DT_STUN)
+						if (power_ > (*it)->getRules()->getArmor())
 						{
-							// power 50 - 150%
-							if (dest->getUnit())
-							{
-								dest->getUnit()->damage(Position(0, 0, 0), (int)(RNG::generate(power_/2.0, power_*1.5)), type);
-							}
-							bool done = false;
-							while (!done)
-							{
-								done = dest->getInventory()->size() == 0;
-								for (std::vector<BattleItem*>::iterator it = dest->getInventory()->begin(); it != dest->getInventory()->end(); )
-								{
-									if (power_ > (*it)->getRules()->getArmor())
-									{
-										_save->removeItem((*it));
-										break;
-									}
-									else
-									{
-										++it;
-										done = it == dest->getInventory()->end();
-									}
-								}
-							}
+							_save->removeItem((*it));
+							break;
 						}
-						if (type == DT_SMOKE)
+						else
 						{
-							// smoke from explosions always stay 6 to 14 turns - power of a smoke grenade is 60
-							if (dest->getSmoke() < 10)
-							{
-								dest->addSmoke(RNG::generate(power_/10, 14));
-							}
+							++it;
+							done = it == dest->getInventory()->end();
 						}
-						if (type == DT_IN && !dest->isVoid())
-						{
-							if (dest->getFire() == 0)
-							{
-								dest->ignite();
-							}
-							if (dest->getUnit())
-							{
-								dest->getUnit()->damage(Position(0, 0, 0), RNG::generate(0, power_/3), type); // immediate IN damage
-								dest->getUnit()->setFire(RNG::generate(1, 5)); // catch fire and burn for 1-5 rounds
-							}
-						}
-
-						if (unit && dest->getUnit() && dest->getUnit()->getFaction() != unit->getFaction())
-						{
-							unit->addFiringExp();
-						}
-
 					}
 				}
-				power_ -= 10; // explosive damage decreases by 10
-				origin = dest;
-				l++;
+			}
+			if (type == DT_SMOKE)
+			{
+				// smoke from explosions always stay 6 to 14 turns - power of a smoke grenade is 60
+				if (dest->getSmoke() < 10)
+				{
+					dest->addSmoke(RNG::generate(power_/10, 14));
+				}
+			}
+			if (type == DT_IN && !dest->isVoid())
+			{
+				if (dest->getFire() == 0)
+				{
+					dest->ignite();
+				}
+				if (dest->getUnit())
+				{
+					dest->getUnit()->damage(Position(0, 0, 0), RNG::generate(0, power_/3), type); // immediate IN damage
+					dest->getUnit()->setFire(RNG::generate(1, 5)); // catch fire and burn for 1-5 rounds
+				}
+			}
+
+			if (unit && dest->getUnit() && dest->getUnit()->getFaction() != unit->getFaction())
+			{
+				unit->addFiringExp();
 			}
 		}
 	}
 	// now detonate the tiles affected with HE
 	if (type == DT_HE)
 	{
-		for (std::set<Tile*>::iterator i = tilesAffected.begin(); i != tilesAffected.end(); ++i)
+		std::sort(tilesAffected.begin(), tilesAffected.end());
+		for (std::vector<int>::iterator i = tilesAffected.begin(); i != tilesAffected.end(); ++i)
 		{
-			(*i)->detonate();
-			applyItemGravity((*i));
+			Tile *tile = _save->getTiles()[*i];
+			tile->detonate();
+			applyItemGravity(tile);
+			invalidateTerrain(tile->getPosition());
 		}
 	}
 
-	calculateSunShading(); // roofs could have been destroyed
-	calculateFOV(center);
-	calculateTerrainLighting(); // fires could have been started
+	calculateFOV(Position(center.x/16, center.y/16, center.z/24));
+	if (!tilesAffected.empty())
+	{
+		// fires could have been started, lamps and flares destroyed, but only where the blast went
+		calculateTerrainLighting(minX, minY, maxX, maxY);
+	}
+}
+
+/**
+ * Traces one ray of an explosion, up to where it runs out of power.
+ * @param data Pointer to the Explosion.
+ * @param ray The number of the ray.
+ */
+void TileEngine::propagateExplosion(void *data, size_t ray)
+{
+	Explosion *explosion = (Explosion*)data;
+	double centerZ = (int)(explosion->center.z / 24) + 0.5;
+	double centerX = (int)(explosion->center.x / 16) + 0.5;
+	double centerY = (int)(explosion->center.y / 16) + 0.5;
+	const BlastStep *steps = &_blastRays[ray * _blastRayLength];
+	BlastHit *hits = &explosion->hits[ray * (explosion->maxRadius + 1)];
+	int count = 0;
+
+	Tile *origin = _save->getTile(explosion->center);
+	int power_ = explosion->power + 1;
+
+	for (int l = 0; power_ > 0 && l <= explosion->maxRadius; ++l)
+	{
+		int tileX = int(floor(centerX + steps[l].x));
+		int tileY = int(floor(centerY + steps[l].y));
+		int tileZ = int(floor(centerZ + steps[l].z));
+
+		Tile *dest = _save->getTile(Position(tileX, tileY, tileZ));
+		if (!dest) break; // out of map!
+
+		// horizontal blockage by walls
+		power_ -= (horizontalBlockage(origin, dest, explosion->type) + verticalBlockage(origin, dest, explosion->type));
+
+		if (power_ > 0)
+		{
+			hits[count].tile = dest;
+			hits[count].power = power_;
+			++count;
+		}
+		power_ -= 10; // explosive damage decreases by 10
+		origin = dest;
+	}
+
+	explosion->hitCounts[ray] = count;
+}
+
+/**
+ * Makes sure the table of explosion rays is long enough. The rays go every 10 degrees
+ * up and down and every 3 degrees around, which makes sure we cover all tiles in a circle.
+ * @param length The number of steps needed on every ray.
+ */
+void TileEngine::buildBlastRays(int length)
+{
+	if (length <= _blastRayLength)
+		return;
+
+	_blastRayLength = length;
+	_blastRays.clear();
+	_blastRays.reserve(BLAST_RAYS * length);
+	for (int fi = -90; fi <= 90; fi += 10)
+	{
+		for (int te = 0; te <= 360; te += 3)
+		{
+			double cos_te = cos(te * M_PI / 180.0);
+			double sin_te = sin(te * M_PI / 180.0);
+			double sin_fi = sin(fi * M_PI / 180.0);
+
+			for (double l = 0; l < length; l++)
+			{
+				BlastStep step;
+				step.x = l * cos_te;
+				step.y = l * sin_te;
+				step.z = (l / 2.0) * sin_fi;
+				_blastRays.push_back(step);
+			}
+		}
+	}
 }
 
 /**
@@ -867,21 +1475,10 @@ int TileEngine::horizontalBlockage(Tile *startTile, Tile *endTile, ItemDamageTyp
  */
 int TileEngine::blockage(Tile *tile, const int part, ItemDamageType type)
 {
-	int blockage = 0;
-
 	if (tile == 0) return 0; // probably outside the map here
 
-	if (tile->getMapData(part))
-	{
-		blockage += tile->getMapData(part)->getBlock(type);
-	}
-
-	// open ufo doors are actually still closed behind the scenes
-	// so a special trick is needed to see if they are open, if they are, they obviously don't block anything
-	if (tile->isUfoDoorOpen(part))
-		blockage = 0;
-
-	return blockage;
+	// the tile keeps this up to date, including open ufo doors
+	return tile->getBlockage(part, type);
 }
 
 
@@ -914,6 +1511,7 @@ int TileEngine::vectorToDirection(const Position &vector)
 int TileEngine::unitOpensDoor(BattleUnit *unit)
 {
 	int door = -1;
+	bool doorOpened = false;
 
 	int size = unit->getArmor()->getSize();
 
@@ -990,9 +1588,20 @@ int TileEngine::unitOpensDoor(BattleUnit *unit)
 					if (tile) tile->openDoor(MapData::O_WESTWALL);
 				}
 			}
+			if (door == 0 || door == 1)
+			{
+				doorOpened = true;
+			}
 		}
 	}
 
+	// big units can open a door on one tile and find none on the next, so don't rely on the returned value alone
+	if (doorOpened)
+	{
+		invalidateTerrain(unit->getPosition());
+		// adjacent doors open up to two tiles further
+		_save->getPathfinding()->invalidateTerrain(unit->getPosition(), size + 2);
+	}
 
 	if (door == 0 || door == 1)
 	{
@@ -1013,22 +1622,30 @@ int TileEngine::closeUfoDoors()
 	// prepare a list of tiles on fire/smoke & close any ufo doors
 	for (int i = 0; i < _save->getWidth() * _save->getLength() * _save->getHeight(); ++i)
 	{
-		doorsclosed += _save->getTiles()[i]->closeUfoDoor();
+		if (_save->getTiles()[i]->closeUfoDoor())
+		{
+			invalidateTerrain(_save->getTiles()[i]->getPosition());
+			doorsclosed++;
+		}
 	}
 
 	return doorsclosed;
 }
 /**
  * calculateLine. Using bresenham algorithm in 3D.
+ * Inside tiles without terrain voxels or units there is nothing to hit, so the line
+ * skips straight to the first voxel of the next tile there, like a tile traversal would.
+ * The voxels visited, and so the result and trajectory, are the same as stepping every voxel.
  * @param origin
  * @param target
  * @param storeTrajectory true will store the whole trajectory - otherwise it just stores the last position.
  * @param trajectory A vector of positions in which the trajectory is stored.
  * @param excludeUnit Excludes this unit in the collision detection.
  * @param doVoxelCheck Check against voxel or tile blocking? (first one for units visibility and line of fire, second one for terrain visibility)
+ * @param smoke Adds up half the smoke of every tile the line enters, up to where it stops. The tile it starts in is not counted.
  * @return the objectnumber(0-3) or unit(4) or out of map (5) or -1(hit nothing)
  */
-int TileEngine::calculateLine(const Position& origin, const Position& target, bool storeTrajectory, std::vector<Position> *trajectory, BattleUnit *excludeUnit, bool doVoxelCheck)
+int TileEngine::calculateLine(const Position& origin, const Position& target, bool storeTrajectory, std::vector<Position> *trajectory, BattleUnit *excludeUnit, bool doVoxelCheck, int *smoke)
 {
 	int x, x0, x1, delta_x, step_x;
 	int y, y0, y1, delta_y, step_y;
@@ -1036,7 +1653,9 @@ int TileEngine::calculateLine(const Position& origin, const Position& target, bo
 	int swap_xy, swap_xz;
 	int drift_xy, drift_xz;
 	int cx, cy, cz;
-	Position lastPoint(origin);
+	int size_x = 16, size_y = 16, size_z = 24;
+	Tile *lastTile = _save->getTile(origin);
+	Position smokeTile(origin.x/16, origin.y/16, origin.z/24);
 
 	//start and end points
 	x0 = origin.x;	 x1 = target.x;
@@ -1049,6 +1668,7 @@ int TileEngine::calculateLine(const Position& origin, const Position& target, bo
 	{
 		std::swap(x0, y0);
 		std::swap(x1, y1);
+		std::swap(size_x, size_y);
 	}
 
 	//do same for xz
@@ -1057,6 +1677,7 @@ int TileEngine::calculateLine(const Position& origin, const Position& target, bo
 	{
 		std::swap(x0, z0);
 		std::swap(x1, z1);
+		std::swap(size_x, size_z);
 	}
 
 	//delta is Length in each plane
@@ -1088,10 +1709,43 @@ int TileEngine::calculateLine(const Position& origin, const Position& target, bo
 		if (swap_xz) std::swap(cx, cz);
 		if (swap_xy) std::swap(cx, cy);
 
+		//passes through a tile with nothing in it? then go to the last voxel of the line in this tile
+		if (doVoxelCheck && !storeTrajectory && x != x1 && cx >= 0 && cy >= 0 && cz >= 0
+			&& isEmptyTile(Position(cx/16, cy/16, cz/24), excludeUnit))
+		{
+			int steps = abs(x1 - x);
+			steps = std::min(steps, (step_x > 0 ? size_x - 1 - x % size_x : x % size_x));
+			steps = std::min(steps, stepsInTile(y, step_y, size_y, drift_xy, delta_x, delta_y));
+			steps = std::min(steps, stepsInTile(z, step_z, size_z, drift_xz, delta_x, delta_z));
+			if (steps > 0)
+			{
+				int moves_y = std::max(0, steps * delta_y - drift_xy + delta_x - 1) / delta_x;
+				int moves_z = std::max(0, steps * delta_z - drift_xz + delta_x - 1) / delta_x;
+				x += step_x * steps;
+				y += step_y * moves_y;
+				z += step_z * moves_z;
+				drift_xy += moves_y * delta_x - steps * delta_y;
+				drift_xz += moves_z * delta_x - steps * delta_z;
+				cx = x;	cy = y;	cz = z;
+				if (swap_xz) std::swap(cx, cz);
+				if (swap_xy) std::swap(cx, cy);
+			}
+		}
+
 		if (storeTrajectory)
 		{
 			trajectory->push_back(Position(cx, cy, cz));
 		}
+		// skipping through an empty tile never leaves it, so no tile is missed here
+		if (smoke && (cx/16 != smokeTile.x || cy/16 != smokeTile.y || cz/24 != smokeTile.z))
+		{
+			smokeTile = Position(cx/16, cy/16, cz/24);
+			Tile *tile = _save->getTile(smokeTile);
+			if (tile)
+			{
+				*smoke += tile->getSmoke()/2;
+			}
+		}
 		//passes through this point?
 		if (doVoxelCheck)
 		{
@@ -1107,14 +1761,15 @@ int TileEngine::calculateLine(const Position& origin, const Position& target, bo
 		}
 		else
 		{
-			int result = horizontalBlockage(_save->getTile(lastPoint), _save->getTile(Position(cx, cy, cz)), DT_NONE)
-					   + verticalBlockage(_save->getTile(lastPoint), _save->getTile(Position(cx, cy, cz)), DT_NONE);
+			// in tile space every step is a tile, look each one up only once
+			Tile *tile = _save->getTile(Position(cx, cy, cz));
+			int result = horizontalBlockage(lastTile, tile, DT_NONE) + verticalBlockage(lastTile, tile, DT_NONE);
 			if (result > 127)
 			{
 				return result;
 			}
 
-			lastPoint = Position(cx, cy, cz);
+			lastTile = tile;
 		}
 		//update progress in other planes
 		drift_xy = drift_xy - delta_y;
@@ -1138,6 +1793,49 @@ int TileEngine::calculateLine(const Position& origin, const Position& target, bo
 	return -1;
 }
 
+/**
+ * Counts the steps of a line along its longest axis before it leaves a tile along a shorter axis.
+ * @param position Current voxel coordinate along the shorter axis.
+ * @param step Direction of the line along the shorter axis.
+ * @param size Size of a tile in voxels along the shorter axis.
+ * @param drift Current drift of the line along the shorter axis.
+ * @param delta Length of the line along its longest axis.
+ * @param shortDelta Length of the line along the shorter axis.
+ * @return The number of steps that stay inside the tile.
+ */
+int TileEngine::stepsInTile(int position, int step, int size, int drift, int delta, int shortDelta) const
+{
+	if (shortDelta == 0)
+	{
+		return delta;
+	}
+	// the line moves along the shorter axis every time the drift goes below zero
+	int moves = step > 0 ? size - position % size : position % size + 1;
+	return ((moves - 1) * delta + drift) / shortDelta;
+}
+
+/**
+ * Checks if a voxel line passing through a tile can't hit anything there.
+ * @param position The tile position.
+ * @param excludeUnit The unit the line can't hit anyway.
+ * @return true if the tile has no terrain voxels and no units in it.
+ */
+bool TileEngine::isEmptyTile(const Position &position, BattleUnit *excludeUnit) const
+{
+	Tile *tile = _save->getTile(position);
+	if (tile == 0 || _voxelPlaneIndex[_save->getTileIndex(position)] != VOXELPLANE_EMPTY)
+	{
+		return false;
+	}
+	if (tile->getUnit() != 0 && tile->getUnit() != excludeUnit)
+	{
+		return false;
+	}
+	// units on the tile below can stick their head into this one
+	Tile *below = _save->getTile(position + Position(0, 0, -1));
+	return below == 0 || below->getUnit() == 0 || below->getUnit() == excludeUnit;
+}
+
 /**
  * Calculate a parabola trajectory, used for throwing items.
  * @param origin in voxelspace
@@ -1203,7 +1901,8 @@ int TileEngine::calculateParabola(const Position& origin, const Position& target
 int TileEngine::voxelCheck(const Position& voxel, BattleUnit *excludeUnit, bool excludeAllUnits)
 {
 
-	Tile *tile = _save->getTile(Position(voxel.x/16, voxel.y/16, voxel.z/24));
+	Position tilePos(voxel.x/16, voxel.y/16, voxel.z/24);
+	Tile *tile = _save->getTile(tilePos);
 	// check if we are not out of the map
 	if (tile == 0 || voxel.x < 0 || voxel.y < 0 || voxel.z < 0)
 	{
@@ -1247,6 +1946,22 @@ int TileEngine::voxelCheck(const Position& voxel, BattleUnit *excludeUnit, bool
 		}
 	}
 
+	// most of the time the terrain voxels of the tile tell us there is nothing to hit
+	int plane = _voxelPlaneIndex[_save->getTileIndex(tilePos)];
+	if (plane == VOXELPLANE_EMPTY)
+	{
+		return -1;
+	}
+	if (plane != VOXELPLANE_LIVE)
+	{
+		Uint16 row = _voxelPlanes[plane * VOXELPLANE_SIZE + ((voxel.z%24)/2)*16 + voxel.y%16];
+		if ((row & (1 << (15 - voxel.x%16))) == 0)
+		{
+			return -1;
+		}
+	}
+
+	// find out which part of the tile we hit
 	for (int i=0; i< 4; ++i)
 	{
 		MapData *mp = tile->getMapData(i);
@@ -1268,6 +1983,87 @@ int TileEngine::voxelCheck(const Position& voxel, BattleUnit *excludeUnit, bool
 
 
 
+/**
+ * Merges the terrain voxels of all parts of a tile, so voxelCheck can find out with a single lookup
+ * whether there is any terrain in a voxel. Tiles with doors are left to the per part check,
+ * because doors open and close without the terrain being invalidated.
+ * @param tile The tile to calculate the voxels of.
+ */
+void TileEngine::calculateVoxelPlanes(Tile *tile)
+{
+	int index = _save->getTileIndex(tile->getPosition());
+	int plane = _voxelPlaneIndex[index];
+	std::vector<Uint16> voxels(VOXELPLANE_SIZE, 0);
+	bool empty = true, live = false;
+
+	for (int i = 0; i < 4 && !live; ++i)
+	{
+		MapData *mp = tile->getMapData(i);
+		if (mp == 0)
+			continue;
+		if (mp->isDoor() || mp->isUFODoor())
+		{
+			live = true;
+			break;
+		}
+		for (int layer = 0; layer < 12 && !live; ++layer)
+		{
+			size_t idx = mp->getLoftID(layer) * 16;
+			if (idx + 16 > _voxelData->size())
+			{
+				// let voxelCheck run into the same error as before
+				live = true;
+				break;
+			}
+			for (int y = 0; y < 16; ++y)
+			{
+				voxels[layer * 16 + y] |= _voxelData->at(idx + y);
+				empty = empty && voxels[layer * 16 + y] == 0;
+			}
+		}
+	}
+
+	if (live || empty)
+	{
+		if (plane >= 0)
+		{
+			_freeVoxelPlanes.push_back(plane);
+		}
+		_voxelPlaneIndex[index] = live ? VOXELPLANE_LIVE : VOXELPLANE_EMPTY;
+		return;
+	}
+
+	if (plane < 0)
+	{
+		if (!_freeVoxelPlanes.empty())
+		{
+			plane = _freeVoxelPlanes.back();
+			_freeVoxelPlanes.pop_back();
+		}
+		else
+		{
+			plane = _voxelPlanes.size() / VOXELPLANE_SIZE;
+			_voxelPlanes.resize(_voxelPlanes.size() + VOXELPLANE_SIZE);
+		}
+	}
+	std::copy(voxels.begin(), voxels.end(), _voxelPlanes.begin() + plane * VOXELPLANE_SIZE);
+	_voxelPlaneIndex[index] = plane;
+}
+
+/**
+ * Merges the terrain voxels of every tile on the map.
+ */
+void TileEngine::calculateVoxelPlanes()
+{
+	_voxelPlanes.clear();
+	_freeVoxelPlanes.clear();
+	std::fill(_voxelPlaneIndex.begin(), _voxelPlaneIndex.end(), (int)VOXELPLANE_LIVE);
+	for (int i = 0; i < _save->getWidth() * _save->getLength() * _save->getHeight(); ++i)
+	{
+		calculateVoxelPlanes(_save->getTiles()[i]);
+	}
+}
+
 /**
  * Toggles personal lighting on / off.
  */
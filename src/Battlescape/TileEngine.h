@@ -33,6 +33,7 @@ class SavedBattleGame;
 class BattleUnit;
 class BattleItem;
 class Tile;
+class LightField;
 
 /**
  * A utility class that modifies tile properties on a battlescape map. This includes lighting, destruction, smoke, fire, fog of war.
@@ -43,18 +44,94 @@ class TileEngine
 private:
 	static const int MAX_VIEW_DISTANCE = 20;
 	static const int MAX_DARKNESS_TO_SEE_UNITS = 9;
+	/// 12 layers of 16 rows of 16 voxels.
+	static const int VOXELPLANE_SIZE = 12 * 16;
+	enum { VOXELPLANE_EMPTY = -1, VOXELPLANE_LIVE = -2 };
+	/// A step of a line of sight in the ray fan, relative to the viewer.
+	struct RayFanNode
+	{
+		Sint8 x, y, z;
+		Uint8 depth;
+		/// Directions with a view cone target in this subtree, and directions this node is a target for.
+		Uint8 coneMask, targetMask;
+		/// Index of the first node after this subtree.
+		int next;
+	};
 	SavedBattleGame *_save;
 	std::vector<Uint16> *_voxelData;
-	void addLight(const Position &center, int power, int layer);
 	int blockage(Tile *tile, const int part, ItemDamageType type);
 	int vectorToDirection(const Position &vector);
 	int voxelCheck(const Position& voxel, BattleUnit *excludeUnit, bool excludeAllUnits = false);
+	bool isEmptyTile(const Position &position, BattleUnit *excludeUnit) const;
+	int stepsInTile(int position, int step, int size, int drift, int delta, int shortDelta) const;
+	bool inViewCone(const Position &origin, int direction, const Position &position, int *scanOrder) const;
+	enum { FOV_TILES_UNCHANGED = -2, FOV_TILES_ALL = -1 };
+	/// What a unit sees, found without changing the battlescape.
+	struct FOVResult
+	{
+		BattleUnit *unit;
+		std::vector<BattleUnit*> units;
+		std::vector<Tile*> tiles;
+		int tileMode;
+	};
+	/// The share of a job one thread works on.
+	struct WorkerThread
+	{
+		TileEngine *engine;
+		void (TileEngine::*job)(void *data, size_t item);
+		void *data;
+		size_t first, step, count;
+	};
+	void runThreads(void (TileEngine::*job)(void *data, size_t item), void *data, size_t count);
+	static int runWorkerThread(void *data);
+	void findFOV(FOVResult *result);
+	void findFOV(void *data, size_t item);
+	bool applyFOV(const FOVResult &result);
+	void findVisibleUnits(BattleUnit *unit, std::vector<BattleUnit*> *units);
+	int findVisibleTiles(BattleUnit *unit, std::vector<Tile*> *tiles);
+	void applyVisibleTiles(BattleUnit *unit, int tileMode, const std::vector<Tile*> &tiles);
 	bool _personalLighting;
+	LightField *_lightField;
+	std::vector<int> _roofLevels;
+	std::vector<Uint16> _voxelPlanes;
+	std::vector<int> _voxelPlaneIndex, _freeVoxelPlanes;
+	void calculateVoxelPlanes(Tile *tile);
+	void calculateSunShading(int x, int y);
+	std::vector<RayFanNode> _rayFan;
+	void buildRayFan();
+	/// 19 rays up and down times 121 rays around.
+	static const int BLAST_RAYS = 19 * 121;
+	/// A step of an explosion ray, relative to the center of the explosion.
+	struct BlastStep
+	{
+		double x, y, z;
+	};
+	/// A tile reached by an explosion ray and the power left there.
+	struct BlastHit
+	{
+		Tile *tile;
+		int power;
+	};
+	/// An explosion while its rays are traced.
+	struct Explosion
+	{
+		Position center;
+		int power, maxRadius;
+		ItemDamageType type;
+		std::vector<BlastHit> hits;
+		std::vector<int> hitCounts;
+	};
+	std::vector<BlastStep> _blastRays;
+	int _blastRayLength;
+	void buildBlastRays(int length);
+	void propagateExplosion(void *data, size_t ray);
 public:
 	/// Creates a new TileEngine class.
 	TileEngine(SavedBattleGame *save, std::vector<Uint16> *voxelData);
 	/// Cleans up the TileEngine.
 	~TileEngine();
+	/// Merge the terrain voxels of the whole map.
+	void calculateVoxelPlanes();
 	/// Calculate sun shading of the whole map.
 	void calculateSunShading();
 	/// Calculate sun shading of a single tile.
@@ -63,10 +140,16 @@ public:
 	bool calculateFOV(BattleUnit *unit);
 	/// Calculate the field of view within range of a certain position.
 	void calculateFOV(const Position &position);
+	/// Calculate the field of view of several units at once.
+	void calculateFOV(const std::vector<BattleUnit*> &units);
+	/// Mark the terrain at a position as changed.
+	void invalidateTerrain(const Position &position);
 	/// Check reaction fire.
 	bool checkReactionFire(BattleUnit *unit, BattleAction *action, BattleUnit *potentialVictim = 0, bool recalculateFOV = true);
 	/// Recalculate lighting of the battlescape.
 	void calculateTerrainLighting();
+	/// Recalculate lighting of the map columns within an area.
+	void calculateTerrainLighting(int x0, int y0, int x1, int y1);
 	/// Recalculate lighting of the battlescape.
 	void calculateUnitLighting();
 	/// Explosions.
@@ -79,7 +162,7 @@ public:
 	/// Close ufo doors.
 	int closeUfoDoors();
 	/// Calculate line.
-	int calculateLine(const Position& origin, const Position& target, bool storeTrajectory, std::vector<Position> *trajectory, BattleUnit *excludeUnit, bool doVoxelCheck = true);
+	int calculateLine(const Position& origin, const Position& target, bool storeTrajectory, std::vector<Position> *trajectory, BattleUnit *excludeUnit, bool doVoxelCheck = true, int *smoke = 0);
 	/// Calculate a parabola trajectory.
 	int calculateParabola(const Position& origin, const Position& target, bool storeTrajectory, std::vector<Position> *trajectory, BattleUnit *excludeUnit, double curvature, double accuracy);
 	bool visible(BattleUnit *currentUnit, Tile *tile);
@@ -88,6 +171,8 @@ public:
 	int horizontalBlockage(Tile *startTile, Tile *endTile, ItemDamageType type);
 	int verticalBlockage(Tile *startTile, Tile *endTile, ItemDamageType type);
 	bool inTeamFOV(const Position &pos, UnitFaction team);
+	/// Find the tiles a unit could see units on by turning around.
+	void findExposedTiles(BattleUnit *unit, std::vector<Tile*> *tiles);
 	bool psiAttack(BattleAction *action);
 	Tile *applyItemGravity(Tile *t);
 };
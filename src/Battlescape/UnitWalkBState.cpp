@@ -112,6 +112,7 @@ void UnitWalkBState::think()
 			if (_unit->getSpecialAbility() == SPECAB_BURNFLOOR)
 			{
 				_unit->getTile()->destroy(MapData::O_FLOOR);
+				_terrain->invalidateTerrain(_unit->getPosition());
 			}
 
 			// move our personal lighting with us
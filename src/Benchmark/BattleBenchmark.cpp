@@ -0,0 +1,223 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <SDL.h>
+#include "../Engine/Game.h"
+#include "../Engine/Options.h"
+#include "../Engine/CrossPlatform.h"
+#include "../Engine/Logger.h"
+#include "../Engine/RNG.h"
+#include "../Engine/SurfaceSet.h"
+#include "../Engine/SoundSet.h"
+#include "../Resource/ResourcePack.h"
+#include "../Ruleset/MapDataSet.h"
+#include "../Savegame/SavedGame.h"
+#include "../Savegame/SavedBattleGame.h"
+#include "../Savegame/BattleUnit.h"
+#include "../Battlescape/BattlescapeState.h"
+#include "../Battlescape/BattlescapeGame.h"
+#include "../Battlescape/PhaseTimer.h"
+
+/*
+ * Plays the alien and civilian turns of a saved battle with no display, to time the AI
+ * and the calculations of the battlescape it sets off. The player's side does nothing,
+ * each round it ends its turn right away. The battle states run frame after frame like
+ * in the game, but without waiting between frames. After each round the time it took,
+ * the time spent in field of view, pathfinding, reaction fire and lighting, and a hash
+ * of the state of the units are printed, so runs of the same save and seed can be
+ * compared. The battle is loaded with the rulesets in the options and the X-Com data
+ * folder, found like the game does or given with -data. Usage:
+ *     openxcom_battle_benchmark [-data folder] [-user folder] <save> [rounds] [seed]
+ * The save is the name of a battlescape save in the user folder, without .sav.
+ * It is linked with HeadlessBattlescape.cpp in place of the parts of the game that
+ * need a display.
+ */
+
+namespace OpenXcom
+{
+
+/**
+ * The resources the battle needs when nothing is drawn or played: the voxel data
+ * of the map, the item sprites that thrown projectiles are made of, and a sound
+ * set that plays nothing. The terrain is loaded by the saved battle itself.
+ */
+class HeadlessResourcePack : public ResourcePack
+{
+public:
+	/// Loads the resources from the data folder.
+	HeadlessResourcePack();
+};
+
+/**
+ * Loads the voxel data and the item sprites from the data folder.
+ */
+HeadlessResourcePack::HeadlessResourcePack() : ResourcePack()
+{
+	MapDataSet::loadLOFTEMPS(CrossPlatform::getDataFile("GEODATA/LOFTEMPS.DAT"), &_voxelData);
+	_sets["FLOOROB.PCK"] = new SurfaceSet(32, 40);
+	_sets["FLOOROB.PCK"]->loadPck(CrossPlatform::getDataFile("UNITS/FLOOROB.PCK"), CrossPlatform::getDataFile("UNITS/FLOOROB.TAB"));
+	_sounds["BATTLE.CAT"] = new SoundSet();
+}
+
+/**
+ * Checks if both sides still have units standing.
+ * @param save Pointer to the saved battle.
+ * @return True if the battle isn't over.
+ */
+static bool battleGoesOn(SavedBattleGame *save)
+{
+	int liveAliens = 0;
+	int liveSoldiers = 0;
+	for (std::vector<BattleUnit*>::iterator i = save->getUnits()->begin(); i != save->getUnits()->end(); ++i)
+	{
+		if (!(*i)->isOut())
+		{
+			if ((*i)->getFaction() == FACTION_HOSTILE)
+				liveAliens++;
+			if ((*i)->getFaction() == FACTION_PLAYER)
+				liveSoldiers++;
+		}
+	}
+	return liveAliens > 0 && liveSoldiers > 0;
+}
+
+}
+
+using namespace OpenXcom;
+
+/// The most frames a round can take before the benchmark gives up on it.
+static const int MAX_FRAMES = 1000000;
+
+int main(int argc, char **argv)
+{
+	// Options come in pairs, the rest are the save, rounds and seed.
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; ++i)
+	{
+		if ((argv[i][0] == '-' || argv[i][0] == '/') && argv[i][1] != 0)
+			++i;
+		else
+			args.push_back(argv[i]);
+	}
+	if (args.empty())
+	{
+		printf("Usage: openxcom_battle_benchmark [-data folder] [-user folder] <save> [rounds] [seed]\n");
+		return EXIT_FAILURE;
+	}
+	int rounds = args.size() > 1 ? atoi(args[1].c_str()) : 10;
+	unsigned int seed = args.size() > 2 ? (unsigned int)atoi(args[2].c_str()) : 0;
+
+	Logger::reportingLevel() = LOG_ERROR;
+	try
+	{
+		if (!Options::init(argc, argv))
+			return EXIT_SUCCESS;
+		// SDL is only used for its timer, which the AI's frame budget runs on.
+		if (SDL_Init(SDL_INIT_TIMER) < 0)
+		{
+			printf("Failed to start SDL: %s\n", SDL_GetError());
+			return EXIT_FAILURE;
+		}
+
+		Game game("");
+		game.loadRuleset();
+		game.setResourcePack(new HeadlessResourcePack());
+		SavedGame *saved = new SavedGame();
+		game.setSavedGame(saved);
+		saved->load(args[0], game.getRuleset());
+		SavedBattleGame *save = saved->getBattleGame();
+		if (save == 0)
+		{
+			printf("%s is not a battlescape save\n", args[0].c_str());
+			return EXIT_FAILURE;
+		}
+		save->loadMapResources(game.getResourcePack());
+		RNG::init(0, seed);
+
+		BattlescapeState state(&game);
+		BattlescapeGame battleGame(save, &state);
+
+		printf("%s, seed %u, state hash %08x\n", args[0].c_str(), seed, save->getStateHash());
+		double total = 0;
+		double phaseTotal[PhaseTimer::PHASES] = {};
+		int round;
+		for (round = 0; round < rounds && battleGoesOn(save); ++round)
+		{
+			double phaseStart[PhaseTimer::PHASES];
+			for (int i = 0; i < PhaseTimer::PHASES; ++i)
+			{
+				phaseStart[i] = PhaseTimer::getTime((PhaseTimer::Phase)i);
+			}
+			double start = CrossPlatform::getMilliseconds();
+
+			// End the player's turn and play the other sides until it comes back.
+			battleGame.requestEndTurn();
+			int frames = 0;
+			while (save->getSide() != FACTION_PLAYER || battleGame.isBusy())
+			{
+				battleGame.think();
+				battleGame.handleState();
+				if (++frames == MAX_FRAMES)
+				{
+					printf("Round %d didn't end after %d frames\n", round + 1, frames);
+					return EXIT_FAILURE;
+				}
+			}
+			// Let the player's panicking units run about, like the game does when the turn begins.
+			battleGame.init();
+			while (true)
+			{
+				battleGame.think();
+				if (!battleGame.isBusy())
+					break;
+				battleGame.handleState();
+			}
+
+			double time = CrossPlatform::getMilliseconds() - start;
+			total += time;
+			printf("Round %d: %.1f ms in %d frames", round + 1, time, frames);
+			for (int i = 0; i < PhaseTimer::PHASES; ++i)
+			{
+				PhaseTimer::Phase phase = (PhaseTimer::Phase)i;
+				double phaseTime = PhaseTimer::getTime(phase) - phaseStart[i];
+				phaseTotal[i] += phaseTime;
+				printf(", %s %.1f ms", PhaseTimer::getName(phase), phaseTime);
+			}
+			printf(", state hash %08x\n", save->getStateHash());
+		}
+
+		printf("Total of %d rounds: %.1f ms", round, total);
+		for (int i = 0; i < PhaseTimer::PHASES; ++i)
+		{
+			printf(", %s %.1f ms", PhaseTimer::getName((PhaseTimer::Phase)i), phaseTotal[i]);
+		}
+		printf(", state hash %08x\n", save->getStateHash());
+	}
+	catch (std::exception &e)
+	{
+		printf("%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+	SDL_Quit();
+	return EXIT_SUCCESS;
+}
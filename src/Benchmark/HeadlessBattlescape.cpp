@@ -0,0 +1,584 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../Engine/Game.h"
+#include "../Engine/State.h"
+#include "../Engine/Language.h"
+#include "../Engine/Options.h"
+#include "../Engine/Sound.h"
+#include "../Engine/SoundSet.h"
+#include "../Interface/Cursor.h"
+#include "../Interface/TextList.h"
+#include "../Resource/ResourcePack.h"
+#include "../Ruleset/Ruleset.h"
+#include "../Savegame/SavedGame.h"
+#include "../Savegame/SavedBattleGame.h"
+#include "../Battlescape/BattlescapeState.h"
+#include "../Battlescape/Map.h"
+#include "../Battlescape/Camera.h"
+#include "../Battlescape/InfoboxOKState.h"
+#include "../Battlescape/InfoboxState.h"
+#include "../Battlescape/NextTurnState.h"
+#include "../Battlescape/UnitInfoState.h"
+
+/*
+ * Headless stand-ins for the parts of the game that need a display or audio, so the
+ * battlescape benchmark can run BattlescapeGame and its battle states without them.
+ * The benchmark is linked with this file instead of the real Game, State, BattlescapeState,
+ * Map, SoundSet and the popups the battle opens: the screen and the sounds do nothing,
+ * popups are closed as soon as they open, and the map only keeps the projectile,
+ * explosions, waypoints and camera the battle states use. Nothing here draws.
+ */
+
+namespace OpenXcom
+{
+
+/**
+ * Sets up a game with no screen, no audio and an empty language.
+ * @param title Title of the game window, not used.
+ */
+Game::Game(const std::string &title) : _screen(0), _cursor(0), _lang(0), _states(), _deleted(), _res(0), _save(0), _rules(0), _quit(false), _init(false), _fpsCounter(0), _mouseActive(true)
+{
+	_cursor = new Cursor(9, 13);
+	_lang = new Language();
+}
+
+/**
+ * Deletes the contents of the game.
+ */
+Game::~Game()
+{
+	delete _cursor;
+	delete _lang;
+	delete _res;
+	delete _save;
+	delete _rules;
+}
+
+/**
+ * Returns the game's cursor, which is never shown.
+ * @return Pointer to the cursor.
+ */
+Cursor *const Game::getCursor() const
+{
+	return _cursor;
+}
+
+/**
+ * Closes a popup as soon as it opens, as if the player clicked it away.
+ * @param state Pointer to the popup.
+ */
+void Game::pushState(State *state)
+{
+	delete state;
+}
+
+/**
+ * Returns the language, which has no strings.
+ * @return Pointer to the language.
+ */
+Language *const Game::getLanguage() const
+{
+	return _lang;
+}
+
+/**
+ * Returns the resource pack in use.
+ * @return Pointer to the resource pack.
+ */
+ResourcePack *const Game::getResourcePack() const
+{
+	return _res;
+}
+
+/**
+ * Sets the resource pack to use.
+ * @param res Pointer to the resource pack.
+ */
+void Game::setResourcePack(ResourcePack *res)
+{
+	_res = res;
+}
+
+/**
+ * Returns the saved game in use.
+ * @return Pointer to the saved game.
+ */
+SavedGame *const Game::getSavedGame() const
+{
+	return _save;
+}
+
+/**
+ * Sets the saved game to use.
+ * @param save Pointer to the saved game.
+ */
+void Game::setSavedGame(SavedGame *save)
+{
+	delete _save;
+	_save = save;
+}
+
+/**
+ * Returns the ruleset in use.
+ * @return Pointer to the ruleset.
+ */
+Ruleset *const Game::getRuleset() const
+{
+	return _rules;
+}
+
+/**
+ * Loads the rulesets set in the options, like the game does.
+ */
+void Game::loadRuleset()
+{
+	_rules = new Ruleset();
+	std::vector<std::string> rulesets = Options::getRulesets();
+	for (std::vector<std::string>::iterator i = rulesets.begin(); i != rulesets.end(); ++i)
+	{
+		_rules->load(*i);
+	}
+}
+
+/**
+ * Sets up a state with nothing to show.
+ * @param game Pointer to the game.
+ */
+State::State(Game *game) : _game(game), _surfaces(), _screen(true)
+{
+}
+
+/**
+ * Deletes the state.
+ */
+State::~State()
+{
+}
+
+/**
+ * Does nothing, there is nothing to show.
+ */
+void State::init()
+{
+}
+
+/**
+ * Does nothing, there is no input.
+ * @param action Pointer to an action.
+ */
+void State::handle(Action *action)
+{
+}
+
+/**
+ * Does nothing, there is nothing to animate.
+ */
+void State::think()
+{
+}
+
+/**
+ * Does nothing, there is nothing to draw.
+ */
+void State::blit()
+{
+}
+
+/**
+ * Sets up the battlescape with a headless map of the battle of the saved game.
+ * Only the map and the battle are set up, the rest of the screen doesn't exist.
+ * @param game Pointer to the game.
+ */
+BattlescapeState::BattlescapeState(Game *game) : State(game)
+{
+	_save = _game->getSavedGame()->getBattleGame();
+	_map = new Map(_game, 320, 200, 0, 0, 200);
+}
+
+/**
+ * Deletes the map.
+ */
+BattlescapeState::~BattlescapeState()
+{
+	delete _map;
+}
+
+/**
+ * Does nothing, the benchmark runs the battle itself.
+ */
+void BattlescapeState::init()
+{
+}
+
+/**
+ * Does nothing, the benchmark runs the battle itself.
+ */
+void BattlescapeState::think()
+{
+}
+
+/**
+ * Does nothing, there is no input.
+ * @param action Pointer to an action.
+ */
+void BattlescapeState::handle(Action *action)
+{
+}
+
+/**
+ * Does nothing, there are no soldier stats on screen.
+ */
+void BattlescapeState::updateSoldierInfo()
+{
+}
+
+/**
+ * Does nothing, the benchmark doesn't wait between frames.
+ * @param interval An interval in ms.
+ */
+void BattlescapeState::setStateInterval(Uint32 interval)
+{
+}
+
+/**
+ * Returns the game.
+ * @return Pointer to the game.
+ */
+Game *BattlescapeState::getGame() const
+{
+	return _game;
+}
+
+/**
+ * Returns the headless map.
+ * @return Pointer to the map.
+ */
+Map *BattlescapeState::getMap() const
+{
+	return _map;
+}
+
+/**
+ * Does nothing, there is nowhere to show a warning.
+ * @param message Warning message.
+ */
+void BattlescapeState::warning(const std::string &message)
+{
+}
+
+/**
+ * Does nothing, there is no launch button.
+ * @param show Show launch button?
+ */
+void BattlescapeState::showLaunchButton(bool show)
+{
+}
+
+/**
+ * Sets up a map with a camera, and nothing to draw with.
+ * @param game Pointer to the core game.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param x X position in pixels.
+ * @param y Y position in pixels.
+ * @param visibleMapHeight Height of the part of the map that would be visible.
+ */
+Map::Map(Game *game, int width, int height, int x, int y, int visibleMapHeight) : InteractiveSurface(width, height, x, y), _scrollTimer(0), _game(game), _save(0), _res(0), _arrow(0), _spriteWidth(32), _spriteHeight(40), _selectorX(0), _selectorY(0), _cursorType(CT_NORMAL), _cursorSize(1), _animFrame(0), _projectile(0), _message(0), _camera(0), _visibleMapHeight(visibleMapHeight)
+{
+	_save = _game->getSavedGame()->getBattleGame();
+	_camera = new Camera(_spriteWidth, _spriteHeight, _save->getWidth(), _save->getLength(), _save->getHeight(), this, visibleMapHeight);
+}
+
+/**
+ * Deletes the camera.
+ */
+Map::~Map()
+{
+	delete _camera;
+}
+
+/**
+ * Does nothing, there are no timers to run.
+ */
+void Map::think()
+{
+}
+
+/**
+ * Does nothing, nothing is drawn.
+ */
+void Map::draw()
+{
+}
+
+/**
+ * Does nothing, nothing is drawn.
+ * @param colors Pointer to the set of colors.
+ * @param firstcolor Offset of the first color to replace.
+ * @param ncolors Amount of colors to replace.
+ */
+void Map::setPalette(SDL_Color *colors, int firstcolor, int ncolors)
+{
+}
+
+/**
+ * Does nothing, there is no input.
+ * @param action Pointer to an action.
+ * @param state State that the action handlers belong to.
+ */
+void Map::mouseClick(Action *action, State *state)
+{
+}
+
+/**
+ * Does nothing, there is no input.
+ * @param action Pointer to an action.
+ * @param state State that the action handlers belong to.
+ */
+void Map::mouseOver(Action *action, State *state)
+{
+}
+
+/**
+ * Does nothing, there is no input.
+ * @param action Pointer to an action.
+ * @param state State that the action handlers belong to.
+ */
+void Map::keyboardPress(Action *action, State *state)
+{
+}
+
+/**
+ * Sets the 3D cursor type, which is never drawn.
+ * @param type Cursor type.
+ * @param size Size of cursor.
+ */
+void Map::setCursorType(CursorType type, int size)
+{
+	_cursorType = type;
+	_cursorSize = size;
+}
+
+/**
+ * Gets the 3D cursor type.
+ * @return Cursor type.
+ */
+CursorType Map::getCursorType() const
+{
+	return _cursorType;
+}
+
+/**
+ * Does nothing, units are never drawn.
+ */
+void Map::cacheUnits()
+{
+}
+
+/**
+ * Does nothing, units are never drawn.
+ * @param unit Pointer to the unit.
+ */
+void Map::cacheUnit(BattleUnit *unit)
+{
+}
+
+/**
+ * Puts a projectile on the map.
+ * @param projectile Pointer to the projectile, or 0 when it's done.
+ */
+void Map::setProjectile(Projectile *projectile)
+{
+	_projectile = projectile;
+}
+
+/**
+ * Gets the projectile on the map.
+ * @return Pointer to the projectile, 0 if there is none.
+ */
+Projectile *Map::getProjectile() const
+{
+	return _projectile;
+}
+
+/**
+ * Gets the explosions going on.
+ * @return Pointer to the set of explosions.
+ */
+std::set<Explosion*> *Map::getExplosions()
+{
+	return &_explosions;
+}
+
+/**
+ * Gets the camera.
+ * @return Pointer to the camera.
+ */
+Camera *Map::getCamera()
+{
+	return _camera;
+}
+
+/**
+ * Gets the waypoints of a blaster bomb.
+ * @return Pointer to the waypoints.
+ */
+std::vector<Position> *Map::getWaypoints()
+{
+	return &_waypoints;
+}
+
+/**
+ * Sets up a sound set with no sounds.
+ */
+SoundSet::SoundSet() : _sounds()
+{
+}
+
+/**
+ * Deletes the sound set.
+ */
+SoundSet::~SoundSet()
+{
+}
+
+/**
+ * Returns a sound that plays nothing, whichever sound was asked for.
+ * @param i Sound number in the set.
+ * @return Pointer to the silent sound.
+ */
+Sound *const SoundSet::getSound(unsigned int i) const
+{
+	static Sound silence;
+	return &silence;
+}
+
+/**
+ * Does nothing, there are no lists to fill.
+ * @param cols Number of columns.
+ * @param ... Text for each cell in the new row.
+ */
+void TextList::addRow(int cols, ...)
+{
+}
+
+/**
+ * Sets up a popup that is closed right away.
+ * @param game Pointer to the core game.
+ * @param name Name of the unit.
+ * @param message Message to show.
+ */
+InfoboxOKState::InfoboxOKState(Game *game, std::wstring name, std::string message) : State(game), _btnOk(0), _window(0), _txtTitle(0), _name(name), _message(message)
+{
+}
+
+/**
+ * Deletes the popup.
+ */
+InfoboxOKState::~InfoboxOKState()
+{
+}
+
+/**
+ * Does nothing, there is nothing to show.
+ */
+void InfoboxOKState::init()
+{
+}
+
+/**
+ * Sets up a popup that is closed right away.
+ * @param game Pointer to the core game.
+ * @param msg Message to show.
+ */
+InfoboxState::InfoboxState(Game *game, const std::wstring &msg) : State(game), _text(0), _window(0), _timer(0)
+{
+}
+
+/**
+ * Deletes the popup.
+ */
+InfoboxState::~InfoboxState()
+{
+}
+
+/**
+ * Does nothing, there is no timer.
+ */
+void InfoboxState::think()
+{
+}
+
+/**
+ * Sets up a next turn screen that is closed right away.
+ * @param game Pointer to the core game.
+ * @param battleGame Pointer to the saved battle.
+ * @param state Pointer to the battlescape.
+ */
+NextTurnState::NextTurnState(Game *game, SavedBattleGame *battleGame, BattlescapeState *state) : State(game), _window(0), _txtTitle(0), _txtTurn(0), _txtSide(0), _txtMessage(0), _battleGame(battleGame), _state(state)
+{
+}
+
+/**
+ * Deletes the screen.
+ */
+NextTurnState::~NextTurnState()
+{
+}
+
+/**
+ * Does nothing, there is no input.
+ * @param action Pointer to an action.
+ */
+void NextTurnState::handle(Action *action)
+{
+}
+
+/**
+ * Sets up a unit info screen that is closed right away.
+ * @param game Pointer to the core game.
+ * @param unit Pointer to the unit.
+ */
+UnitInfoState::UnitInfoState(Game *game, BattleUnit *unit) : State(game), _unit(unit)
+{
+}
+
+/**
+ * Deletes the screen.
+ */
+UnitInfoState::~UnitInfoState()
+{
+}
+
+/**
+ * Does nothing, there is nothing to show.
+ */
+void UnitInfoState::init()
+{
+}
+
+/**
+ * Does nothing, there is no input.
+ * @param action Pointer to an action.
+ */
+void UnitInfoState::handle(Action *action)
+{
+}
+
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <queue>
+#include <vector>
+#include "../Battlescape/Position.h"
+#include "../Battlescape/PathfindingNode.h"
+#include "../Battlescape/PathfindingOpenSet.h"
+
+/*
+ * Compares the pathfinding open set with the priority queue it replaced, by running the
+ * same A* searches with both on battlescape sized maps of 60x60 tiles and 4 levels.
+ * The maps are made up like the battlescape: walls, rough ground and stairs between
+ * levels, with the TU costs and moves of Pathfinding. Usage:
+ *     openxcom_openset_benchmark [searches per map] [maps]
+ */
+
+namespace OpenXcom
+{
+
+/// A wall, like Pathfinding's blocked moves.
+static const int BLOCKED = 255;
+
+/**
+ * A pseudo random number generator that gives the same maps on every platform.
+ */
+class BenchmarkRandom
+{
+private:
+	unsigned int _state;
+public:
+	BenchmarkRandom(unsigned int seed) : _state(seed) {}
+	/// Gets a number from 0 to max - 1.
+	int generate(int max)
+	{
+		_state = _state * 1103515245 + 12345;
+		return (_state >> 16) % max;
+	}
+};
+
+/**
+ * A battlescape sized map with a TU cost for walking onto each tile, and the nodes to search it.
+ */
+struct BenchmarkMap
+{
+	int width, length, height;
+	std::vector<int> cost;
+	std::vector<bool> stairs;
+	std::vector<PathfindingNode> nodes;
+	unsigned int search;
+
+	/**
+	 * Makes up a map.
+	 * @param random The random generator.
+	 */
+	BenchmarkMap(BenchmarkRandom &random) : width(60), length(60), height(4), cost(), stairs(), nodes(), search(0)
+	{
+		for (int z = 0; z < height; ++z)
+			for (int y = 0; y < length; ++y)
+				for (int x = 0; x < width; ++x)
+				{
+					int r = random.generate(100);
+					// upper levels are mostly roofs and empty air
+					int walls = z == 0 ? 20 : 60;
+					cost.push_back(r < walls ? BLOCKED : r < walls + 10 ? 6 : 4);
+					stairs.push_back(r >= walls && random.generate(50) == 0);
+					nodes.push_back(PathfindingNode(Position(x, y, z)));
+				}
+	}
+
+	/// Gets the index of a position.
+	int index(const Position &p) const { return (p.z * length + p.y) * width + p.x; }
+
+	/// Checks if a position is on the map.
+	bool onMap(const Position &p) const { return p.x >= 0 && p.x < width && p.y >= 0 && p.y < length && p.z >= 0 && p.z < height; }
+
+	/**
+	 * Gets the TU cost of a move, like Pathfinding::getTUCost.
+	 * @param from The position to move from.
+	 * @param direction The direction, 8 is up and 9 is down.
+	 * @param to Receives the position moved to.
+	 * @return The TU cost, BLOCKED if the move is not possible.
+	 */
+	int getTUCost(const Position &from, int direction, Position *to) const
+	{
+		static const int dx[10] = {0, 1, 1, 1, 0, -1, -1, -1, 0, 0};
+		static const int dy[10] = {-1, -1, 0, 1, 1, 1, 0, -1, 0, 0};
+		static const int dz[10] = {0, 0, 0, 0, 0, 0, 0, 0, 1, -1};
+		*to = from + Position(dx[direction], dy[direction], dz[direction]);
+		if (!onMap(*to) || cost[index(*to)] == BLOCKED)
+			return BLOCKED;
+		if (direction >= 8)
+			return stairs[index(direction == 8 ? from : *to)] ? 8 : BLOCKED;
+		int tu = cost[index(*to)];
+		if (direction & 1)
+			tu = (int)((double)tu * 1.5);
+		return tu;
+	}
+
+	/**
+	 * Gets the node of a position, reset for the current search, like Pathfinding::getNode.
+	 * @param p The position.
+	 * @return The node.
+	 */
+	PathfindingNode *getNode(const Position &p)
+	{
+		PathfindingNode *node = &nodes[index(p)];
+		if (!node->isSearched(search))
+			node->reset(search);
+		return node;
+	}
+
+	/**
+	 * Picks a random position that can be walked on.
+	 * @param random The random generator.
+	 * @return The position.
+	 */
+	Position randomPosition(BenchmarkRandom &random) const
+	{
+		Position p;
+		do
+		{
+			p = Position(random.generate(width), random.generate(length), random.generate(height));
+		} while (cost[index(p)] == BLOCKED);
+		return p;
+	}
+};
+
+/**
+ * The open set Pathfinding uses, for the benchmark searches.
+ */
+class HeapSet
+{
+private:
+	PathfindingOpenSet _set;
+public:
+	HeapSet(BenchmarkMap &) : _set() {}
+	void push(PathfindingNode *node) { _set.push(node); }
+	PathfindingNode *pop() { return _set.pop(); }
+	bool empty() const { return _set.empty(); }
+	bool contains(PathfindingNode *node) const { return node->inOpenSet(); }
+	void clear() { _set.clear(); }
+};
+
+/**
+ * The open set as it was before: a priority queue of entries allocated for every push,
+ * with the old entry of a node left in the queue and skipped when it comes up.
+ * Nodes have no room for their entry any more, so the map keeps them on the side.
+ */
+class LegacySet
+{
+private:
+	struct Entry
+	{
+		int cost;
+		PathfindingNode *node;
+	};
+	struct EntryCompare
+	{
+		bool operator()(Entry *a, Entry *b) const { return b->cost < a->cost; }
+	};
+	BenchmarkMap &_map;
+	std::priority_queue<Entry*, std::vector<Entry*>, EntryCompare> _queue;
+	std::vector<Entry*> _entries;
+
+	void removeDiscarded()
+	{
+		while (!_queue.empty() && !_queue.top()->node)
+		{
+			delete _queue.top();
+			_queue.pop();
+		}
+	}
+public:
+	LegacySet(BenchmarkMap &map) : _map(map), _queue(), _entries(map.nodes.size(), (Entry*)0) {}
+	~LegacySet() { clear(); }
+	void push(PathfindingNode *node)
+	{
+		Entry *entry = new Entry;
+		entry->node = node;
+		entry->cost = node->getTUCost() + node->getTUGuess();
+		Entry *&old = _entries[_map.index(node->getPosition())];
+		if (old)
+			old->node = 0;
+		old = entry;
+		_queue.push(entry);
+	}
+	PathfindingNode *pop()
+	{
+		PathfindingNode *node = _queue.top()->node;
+		delete _queue.top();
+		_queue.pop();
+		_entries[_map.index(node->getPosition())] = 0;
+		removeDiscarded();
+		return node;
+	}
+	bool empty() const { return _queue.empty(); }
+	bool contains(PathfindingNode *node) const { return _entries[_map.index(node->getPosition())] != 0; }
+	void clear()
+	{
+		while (!_queue.empty())
+		{
+			if (_queue.top()->node)
+				_entries[_map.index(_queue.top()->node->getPosition())] = 0;
+			delete _queue.top();
+			_queue.pop();
+		}
+	}
+};
+
+/**
+ * Runs an A* search the way Pathfinding::aStarPath does.
+ * @param map The map.
+ * @param openSet The open set to use.
+ * @param start The position to start from.
+ * @param end The position to reach.
+ * @param pushes Adds the number of nodes pushed.
+ * @return The TU cost of the path, -1 if there is none.
+ */
+template<typename OpenSet>
+static int aStar(BenchmarkMap &map, OpenSet &openSet, const Position &start, const Position &end, long *pushes)
+{
+	map.search++;
+	openSet.clear();
+	PathfindingNode *startNode = map.getNode(start);
+	startNode->connect(0, 0, 0, end);
+	openSet.push(startNode);
+	++*pushes;
+	while (!openSet.empty())
+	{
+		PathfindingNode *current = openSet.pop();
+		current->setChecked();
+		if (current->getPosition() == end)
+			return current->getTUCost();
+		for (int direction = 0; direction < 10; ++direction)
+		{
+			Position nextPos;
+			int tuCost = map.getTUCost(current->getPosition(), direction, &nextPos);
+			if (tuCost == BLOCKED)
+				continue;
+			PathfindingNode *next = map.getNode(nextPos);
+			if (next->isChecked())
+				continue;
+			int total = current->getTUCost() + tuCost;
+			if (!openSet.contains(next) || next->getTUCost() > total)
+			{
+				next->connect(total, current, direction, end);
+				openSet.push(next);
+				++*pushes;
+			}
+		}
+	}
+	return -1;
+}
+
+/**
+ * Times the searches of a map with one kind of open set.
+ * @param map The map.
+ * @param searches The start and end of each search.
+ * @param costs Receives the cost of each path.
+ * @param pushes Adds the number of nodes pushed.
+ * @return The time taken in milliseconds.
+ */
+template<typename OpenSet>
+static double timeSearches(BenchmarkMap &map, const std::vector<std::pair<Position, Position> > &searches, std::vector<int> *costs, long *pushes)
+{
+	OpenSet openSet(map);
+	costs->clear();
+	std::clock_t start = std::clock();
+	for (std::vector<std::pair<Position, Position> >::const_iterator i = searches.begin(); i != searches.end(); ++i)
+	{
+		costs->push_back(aStar(map, openSet, i->first, i->second, pushes));
+	}
+	return (std::clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+}
+
+using namespace OpenXcom;
+
+int main(int argc, char **argv)
+{
+	int searchCount = argc > 1 ? atoi(argv[1]) : 500;
+	int mapCount = argc > 2 ? atoi(argv[2]) : 8;
+
+	BenchmarkRandom random(1);
+	double legacyTime = 0, heapTime = 0;
+	long legacyPushes = 0, heapPushes = 0;
+	int mismatches = 0;
+	for (int m = 0; m < mapCount; ++m)
+	{
+		BenchmarkMap map(random);
+		std::vector<std::pair<Position, Position> > searches;
+		for (int i = 0; i < searchCount; ++i)
+		{
+			Position start = map.randomPosition(random);
+			searches.push_back(std::make_pair(start, map.randomPosition(random)));
+		}
+		std::vector<int> legacyCosts, heapCosts;
+		legacyTime += timeSearches<LegacySet>(map, searches, &legacyCosts, &legacyPushes);
+		heapTime += timeSearches<HeapSet>(map, searches, &heapCosts, &heapPushes);
+		for (size_t i = 0; i < searches.size(); ++i)
+		{
+			if (legacyCosts[i] != heapCosts[i])
+				mismatches++;
+		}
+	}
+
+	printf("%d maps of 60x60x4, %d searches each\n", mapCount, searchCount);
+	printf("priority queue: %8.1f ms, %ld pushes\n", legacyTime, legacyPushes);
+	printf("indexed heap:   %8.1f ms, %ld pushes\n", heapTime, heapPushes);
+	if (heapTime > 0)
+		printf("speed-up:       %8.2fx\n", legacyTime / heapTime);
+	if (mismatches)
+	{
+		printf("%d searches found paths of different cost\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
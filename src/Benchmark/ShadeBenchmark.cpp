@@ -0,0 +1,178 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "../Engine/ShadeRow.h"
+
+/*
+ * Compares the SSE2 rows of Surface::blitNShade with the color functions they stand in for.
+ * First it checks both give the same pixels for every source pixel, shade and color,
+ * including the shades below 0 and above 255 the kernel leaves to the color functions,
+ * then it times both on rows as wide as a terrain sprite and as the screen. Usage:
+ *     openxcom_shade_benchmark [rows]
+ */
+
+namespace OpenXcom
+{
+
+/// The shades checked past the ones a tile can have.
+static const int EXTREME_SHADES[] = { -100000, -1024, 1024, 100000 };
+
+/**
+ * Shades a row like the row drawers of Surface::blitNShade do.
+ * @param dest Destination pixels.
+ * @param src Source pixels.
+ * @param count Number of pixels.
+ * @param shade Shade of the row.
+ * @param newColor New color, or -1 to keep the color of each pixel.
+ */
+static void shadeFast(Uint8 *dest, const Uint8 *src, int count, int shade, int newColor)
+{
+	for (int x = shadeRow(dest, src, count, shade, newColor); x < count; ++x)
+	{
+		if (newColor < 0)
+			StandartShade::func(dest[x], src[x], shade, 0, 0);
+		else
+			ColorReplace::func(dest[x], src[x], shade, newColor, 0);
+	}
+}
+
+/**
+ * Shades a row one pixel at a time with the color functions.
+ * @param dest Destination pixels.
+ * @param src Source pixels.
+ * @param count Number of pixels.
+ * @param shade Shade of the row.
+ * @param newColor New color, or -1 to keep the color of each pixel.
+ */
+static void shadeScalar(Uint8 *dest, const Uint8 *src, int count, int shade, int newColor)
+{
+	for (int x = 0; x < count; ++x)
+	{
+		if (newColor < 0)
+			StandartShade::func(dest[x], src[x], shade, 0, 0);
+		else
+			ColorReplace::func(dest[x], src[x], shade, newColor, 0);
+	}
+}
+
+/**
+ * Checks both ways give the same pixels for one shade and color. The row holds every
+ * source pixel and a few more, so the part left to the color functions is checked too.
+ * @param shade Shade of the row.
+ * @param newColor New color, or -1 to keep the color of each pixel.
+ * @return True if the pixels are the same.
+ */
+static bool check(int shade, int newColor)
+{
+	const int count = 256 + 13;
+	Uint8 src[count], fast[count], scalar[count];
+	for (int x = 0; x < count; ++x)
+	{
+		src[x] = x & 255;
+		// transparent pixels have to leave what was there
+		fast[x] = scalar[x] = (x * 7 + 3) & 255;
+	}
+	shadeFast(fast, src, count, shade, newColor);
+	shadeScalar(scalar, src, count, shade, newColor);
+	for (int x = 0; x < count; ++x)
+	{
+		if (fast[x] != scalar[x])
+		{
+			printf("shade %d, color %d, pixel %d: %d instead of %d\n", shade, newColor, src[x], fast[x], scalar[x]);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Times shading the same rows one way.
+ * @param shadeFunc The way to shade.
+ * @param width Width of the rows.
+ * @param rows Number of rows.
+ * @param sum Adds up the pixels, so nothing is left out by the compiler.
+ * @return The time taken in milliseconds.
+ */
+static double timeRows(void (*shadeFunc)(Uint8*, const Uint8*, int, int, int), int width, int rows, unsigned int *sum)
+{
+	std::vector<Uint8> src(width * 16), dest(width);
+	unsigned int state = 1;
+	for (size_t i = 0; i < src.size(); ++i)
+	{
+		state = state * 1103515245 + 12345;
+		// about a quarter of a sprite is transparent
+		src[i] = (state >> 16) % 4 ? (state >> 8) & 255 : 0;
+	}
+	std::clock_t start = std::clock();
+	for (int i = 0; i < rows; ++i)
+	{
+		shadeFunc(&dest[0], &src[(i % 16) * width], width, i % 16, i % 3 ? -1 : (i % 16) << 4);
+		*sum += dest[i % width];
+	}
+	return (std::clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+}
+
+using namespace OpenXcom;
+
+int main(int argc, char **argv)
+{
+	int rows = argc > 1 ? atoi(argv[1]) : 2000000;
+
+	std::vector<int> shades;
+	for (int shade = -300; shade <= 600; ++shade)
+		shades.push_back(shade);
+	for (size_t i = 0; i < sizeof(EXTREME_SHADES) / sizeof(EXTREME_SHADES[0]); ++i)
+		shades.push_back(EXTREME_SHADES[i]);
+	for (std::vector<int>::const_iterator i = shades.begin(); i != shades.end(); ++i)
+	{
+		for (int newColor = -1; newColor < 256; ++newColor)
+		{
+			if (!check(*i, newColor))
+				return 1;
+		}
+	}
+	printf("same pixels for %d shades from %d to %d and every color\n", (int)shades.size(), EXTREME_SHADES[0], EXTREME_SHADES[sizeof(EXTREME_SHADES) / sizeof(EXTREME_SHADES[0]) - 1]);
+
+#ifndef OPENXCOM_SSE2
+	printf("built without SSE2, both ways are the color functions\n");
+#endif
+	const int widths[] = { 32, 320 };
+	for (int i = 0; i < 2; ++i)
+	{
+		unsigned int fastSum = 0, scalarSum = 0;
+		double scalarTime = timeRows(shadeScalar, widths[i], rows, &scalarSum);
+		double fastTime = timeRows(shadeFast, widths[i], rows, &fastSum);
+		printf("%d rows of %d pixels\n", rows, widths[i]);
+		printf("color functions: %8.1f ms\n", scalarTime);
+		printf("sse2 rows:       %8.1f ms\n", fastTime);
+		if (fastTime > 0)
+			printf("speed-up:        %8.2fx\n", scalarTime / fastTime);
+		if (fastSum != scalarSum)
+		{
+			printf("the timed rows came out different\n");
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -43,6 +43,7 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <sys/time.h>
 #endif
 
 namespace OpenXcom
@@ -463,5 +464,39 @@ bool deleteFile(const std::string &path)
 #endif
 }
 
+/**
+ * Gets the number of processors available to the game.
+ * @return Number of processors, at least 1.
+ */
+int getProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+/**
+ * Gets the time from a high resolution clock, for measuring how long things take.
+ * @return Milliseconds since some fixed point in the past.
+ */
+double getMilliseconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, frequency;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+	return count.QuadPart * 1000.0 / frequency.QuadPart;
+#else
+	timeval time;
+	gettimeofday(&time, 0);
+	return time.tv_sec * 1000.0 + time.tv_usec / 1000.0;
+#endif
+}
+
 }
 }
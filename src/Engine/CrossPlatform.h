@@ -53,6 +53,10 @@ namespace CrossPlatform
 	bool fileExists(const std::string &path);
 	/// Deletes the specified file.
 	bool deleteFile(const std::string &path);
+	/// Gets the number of processors in the system.
+	int getProcessorCount();
+	/// Gets the time from a high resolution clock.
+	double getMilliseconds();
 }
 
 }
@@ -78,6 +78,8 @@ void createDefault()
 	setBool("battleAltGrenade", false); // set to true if you want to play with the alternative grenade handling
 	setBool("battlePreviewPath", false);
 	setBool("battleRangeBasedAccuracy", false);
+	setInt("battleThreads", 0); // threads used for end of turn calculations, 0 = one per processor
+	setInt("battleAIFrameBudget", 10); // milliseconds the AI may think before letting a frame be drawn
 	setBool("fpsCounter", false);
 	setBool("craftLaunchAlways", false);
 	setBool("globeSeasons", false);
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ShadeCache.h"
+#include <climits>
+#include "SpanSprite.h"
+
+namespace OpenXcom
+{
+
+std::map<ShadeCache::Key, ShadeCache::Entry> ShadeCache::_entries;
+std::list<ShadeCache::Key> ShadeCache::_uses;
+size_t ShadeCache::_size = 0;
+
+/**
+ * Gets the cached copy of a sprite with a certain shade and color, and marks it as just used.
+ * @param surface Pointer to the original sprite.
+ * @param shade Shade the copy was made with.
+ * @param color New base color the copy was made with, 0 for none.
+ * @return Pointer to the copy, or 0 if there is none.
+ */
+SpanSprite *ShadeCache::get(const Surface *surface, int shade, int color)
+{
+	std::map<Key, Entry>::iterator i = _entries.find(std::make_pair(surface, std::make_pair(shade, color)));
+	if (i == _entries.end())
+	{
+		return 0;
+	}
+	_uses.splice(_uses.begin(), _uses, i->second.use);
+	return i->second.sprite;
+}
+
+/**
+ * Adds a copy of a sprite to the cache, which takes care of deleting it.
+ * Makes room by dropping the least recently used copies, but never the one just added.
+ * @param surface Pointer to the original sprite.
+ * @param shade Shade the copy was made with.
+ * @param color New base color the copy was made with, 0 for none.
+ * @param sprite Pointer to the copy.
+ */
+void ShadeCache::add(const Surface *surface, int shade, int color, SpanSprite *sprite)
+{
+	Key key = std::make_pair(surface, std::make_pair(shade, color));
+	_uses.push_front(key);
+	Entry entry;
+	entry.sprite = sprite;
+	entry.use = _uses.begin();
+	_entries[key] = entry;
+	_size += sprite->getSize();
+
+	while (_size > MAX_SIZE && _uses.size() > 1)
+	{
+		std::map<Key, Entry>::iterator i = _entries.find(_uses.back());
+		_size -= i->second.sprite->getSize();
+		delete i->second.sprite;
+		_entries.erase(i);
+		_uses.pop_back();
+	}
+}
+
+/**
+ * Drops the cached copies of a sprite, for when the sprite is deleted.
+ * @param surface Pointer to the original sprite.
+ */
+void ShadeCache::remove(const Surface *surface)
+{
+	std::map<Key, Entry>::iterator i = _entries.lower_bound(std::make_pair(surface, std::make_pair(INT_MIN, INT_MIN)));
+	while (i != _entries.end() && i->first.first == surface)
+	{
+		_size -= i->second.sprite->getSize();
+		delete i->second.sprite;
+		_uses.erase(i->second.use);
+		_entries.erase(i++);
+	}
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_SHADECACHE_H
+#define OPENXCOM_SHADECACHE_H
+
+#include <map>
+#include <list>
+#include <utility>
+
+namespace OpenXcom
+{
+
+class Surface;
+class SpanSprite;
+
+/**
+ * Keeps shaded and recolored copies of sprites for Surface::blitNShade,
+ * so a sprite drawn again with the same shade is just copied.
+ * The least recently used copies are dropped when the cache gets too big.
+ * Only surfaces whose pixels never change may be cached.
+ */
+class ShadeCache
+{
+private:
+	/// How much memory the cached copies may take, in bytes.
+	static const size_t MAX_SIZE = 4 * 1024 * 1024;
+	/// A sprite with a shade and a new base color.
+	typedef std::pair<const Surface*, std::pair<int, int> > Key;
+	struct Entry
+	{
+		SpanSprite *sprite;
+		std::list<Key>::iterator use;
+	};
+	static std::map<Key, Entry> _entries;
+	/// Keys of the entries, most recently used first.
+	static std::list<Key> _uses;
+	static size_t _size;
+public:
+	/// Gets the cached copy of a sprite.
+	static SpanSprite *get(const Surface *surface, int shade, int color);
+	/// Adds a copy of a sprite to the cache.
+	static void add(const Surface *surface, int shade, int color, SpanSprite *sprite);
+	/// Drops the cached copies of a sprite.
+	static void remove(const Surface *surface);
+};
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_SHADEROW_H
+#define OPENXCOM_SHADEROW_H
+
+#include <SDL.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OPENXCOM_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace OpenXcom
+{
+
+/**
+ * help class used for Surface::blitNShade
+ */
+struct ColorReplace
+{
+	
+	/**
+	* Function used by ShaderDraw in Surface::blitNShade
+	* set shade and replace color in that surface
+	* @param dest destination pixel
+	* @param src source pixel
+	* @param shade value of shade of this surface
+	* @param newColor new color to set (it should be offseted by 4)
+	* @param notused
+	*/
+	static inline void func(Uint8& dest, const Uint8& src, const int& shade, const int& newColor, const int&)
+	{
+		if(src)
+		{
+			const int newShade = (src&15) + shade;
+			if (newShade > 15)
+				// so dark it would flip over to another color - make it black instead
+				dest = 15;
+			else
+				dest = newColor | newShade;
+		}
+	}
+	
+};
+
+/**
+ * help class used for Surface::blitNShade
+ */
+struct StandartShade
+{
+	/**
+	* Function used by ShaderDraw in Surface::blitNShade
+	* set shade
+	* @param dest destination pixel
+	* @param src source pixel
+	* @param shade value of shade of this surface
+	* @param notused
+	* @param notused
+	*/
+	static inline void func(Uint8& dest, const Uint8& src, const int& shade, const int&, const int&)
+	{
+		if(src)
+		{
+			const int newShade = (src&15) + shade;
+			if (newShade > 15)
+				// so dark it would flip over to another color - make it black instead
+				dest = 15;
+			else
+				dest = (src&(15<<4)) | newShade;
+		}
+	}
+	
+};
+
+/**
+ * Shades a row of pixels 16 at a time, the same way as StandartShade
+ * or, with a new color, as ColorReplace.
+ * Only done with SSE2, and only for shades that don't lighten the pixels.
+ * @param dest destination pixels
+ * @param src source pixels
+ * @param count number of pixels in the row
+ * @param shade value of shade of the row
+ * @param newColor new color to set, or -1 to keep the color of each pixel
+ * @return number of pixels done, the rest are left to the color function
+ */
+inline int shadeRow(Uint8 *dest, const Uint8 *src, int count, int shade, int newColor)
+{
+#ifdef OPENXCOM_SSE2
+	if (shade < 0)
+		return 0;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i low = _mm_set1_epi8(15);
+	// anything past 15 ends up black, so a saturated add gives the same result
+	const __m128i shadeV = _mm_set1_epi8((char)(shade > 255 ? 255 : shade));
+	const __m128i colorV = _mm_set1_epi8((char)(newColor & 0xFF));
+	int x = 0;
+	for (; x + 16 <= count; x += 16)
+	{
+		const __m128i s = _mm_loadu_si128((const __m128i*)(src + x));
+		const __m128i d = _mm_loadu_si128((const __m128i*)(dest + x));
+		const __m128i transparent = _mm_cmpeq_epi8(s, zero);
+		const __m128i newShade = _mm_adds_epu8(_mm_and_si128(s, low), shadeV);
+		const __m128i inRange = _mm_cmpeq_epi8(_mm_subs_epu8(newShade, low), zero);
+		const __m128i color = newColor < 0 ? _mm_andnot_si128(low, s) : colorV;
+		const __m128i shaded = _mm_or_si128(_mm_and_si128(inRange, _mm_or_si128(color, newShade)), _mm_andnot_si128(inRange, low));
+		_mm_storeu_si128((__m128i*)(dest + x), _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, shaded)));
+	}
+	return x;
+#else
+	return 0;
+#endif
+}
+
+}
+
+#endif
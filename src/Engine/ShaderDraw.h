@@ -24,6 +24,30 @@
 	
 namespace OpenXcom
 {
+
+namespace helper
+{
+
+/**
+ * Draws one row of pixels for `ShaderDraw`.
+ * This version goes pixel by pixel through `ColorFunc::func`. It can be specialized
+ * for a color function and argument types to draw whole rows faster,
+ * as long as every pixel ends up exactly the same.
+ * @param count number of pixels in the row
+ */
+template<typename ColorFunc, typename DestType, typename Src0Type, typename Src1Type, typename Src2Type, typename Src3Type>
+struct row_drawer
+{
+	static inline void draw(controler<DestType>& dest, controler<Src0Type>& src0, controler<Src1Type>& src1, controler<Src2Type>& src2, controler<Src3Type>& src3, int count)
+	{
+		for(int x = count; x>0; --x, dest.inc_x(), src0.inc_x(), src1.inc_x(), src2.inc_x(), src3.inc_x())
+		{
+			ColorFunc::func(dest.get_ref(), src0.get_ref(), src1.get_ref(), src2.get_ref(), src3.get_ref());
+		}
+	}
+};
+
+}//namespace helper
 	
 /**
  * Universal blit function
@@ -101,10 +125,7 @@ inline void ShaderDraw(const DestType& dest_frame, const Src0Type& src0_frame, c
 		src3.set_x(begin_x, end_x);
 		
 		//iteration on x-axis
-		for(int x = end_x-begin_x; x>0; --x, dest.inc_x(), src0.inc_x(), src1.inc_x(), src2.inc_x(), src3.inc_x())
-		{
-			ColorFunc::func(dest.get_ref(), src0.get_ref(), src1.get_ref(), src2.get_ref(), src3.get_ref());				
-		}
+		helper::row_drawer<ColorFunc, DestType, Src0Type, Src1Type, Src2Type, Src3Type>::draw(dest, src0, src1, src2, src3, end_x-begin_x);
 	}
 
 };
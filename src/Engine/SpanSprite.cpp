@@ -0,0 +1,114 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SpanSprite.h"
+#include <algorithm>
+#include <cstring>
+#include "Surface.h"
+
+namespace OpenXcom
+{
+
+/**
+ * Sets up a span sprite with the opaque pixels of a surface.
+ * @param surface Pointer to the surface to copy.
+ */
+SpanSprite::SpanSprite(Surface *surface) : _width(surface->getWidth()), _height(surface->getHeight())
+{
+	SDL_Surface *s = surface->getSurface();
+	_rows.reserve(_height + 1);
+	for (int y = 0; y < _height; ++y)
+	{
+		const Uint8 *row = (const Uint8*)s->pixels + y * s->pitch;
+		_rows.push_back(_spans.size());
+		int x = 0;
+		while (x < _width)
+		{
+			// skip the transparent pixels, then take every pixel up to the next transparent one
+			while (x < _width && row[x] == 0)
+				++x;
+			if (x == _width)
+				break;
+			Span span;
+			span.x = x;
+			span.offset = _pixels.size();
+			while (x < _width && row[x] != 0)
+			{
+				_pixels.push_back(row[x]);
+				++x;
+			}
+			span.length = x - span.x;
+			_spans.push_back(span);
+		}
+	}
+	_rows.push_back(_spans.size());
+}
+
+/**
+ * Deletes the span sprite.
+ */
+SpanSprite::~SpanSprite()
+{
+}
+
+/**
+ * Copies the opaque pixels of the sprite onto a surface, keeping
+ * within the clipping rectangle of the surface.
+ * Notice there is no surface locking here, just like Surface::blitNShade.
+ * @param surface Pointer to the surface to draw on.
+ * @param x X position on the surface.
+ * @param y Y position on the surface.
+ * @param half Only draw the right half of the sprite.
+ */
+void SpanSprite::blit(Surface *surface, int x, int y, bool half) const
+{
+	SDL_Surface *s = surface->getSurface();
+	const SDL_Rect &clip = s->clip_rect;
+	int beginX = std::max(clip.x - x, half ? _width / 2 : 0);
+	int endX = std::min(clip.x + clip.w - x, _width);
+	int beginY = std::max(clip.y - y, 0);
+	int endY = std::min(clip.y + clip.h - y, _height);
+	if (beginX >= endX || beginY >= endY)
+		return;
+
+	Uint8 *row = (Uint8*)s->pixels + (y + beginY) * s->pitch + x;
+	for (int sy = beginY; sy < endY; ++sy, row += s->pitch)
+	{
+		for (int i = _rows[sy]; i < _rows[sy + 1]; ++i)
+		{
+			const Span &span = _spans[i];
+			int begin = std::max((int)span.x, beginX);
+			int end = std::min(span.x + span.length, endX);
+			if (begin < end)
+			{
+				memcpy(row + begin, &_pixels[span.offset + begin - span.x], end - begin);
+			}
+		}
+	}
+}
+
+/**
+ * Gets the memory used by the spans and pixels of the sprite.
+ * @return Size in bytes.
+ */
+size_t SpanSprite::getSize() const
+{
+	return sizeof(SpanSprite) + _spans.size() * sizeof(Span) + _rows.size() * sizeof(int) + _pixels.size();
+}
+
+}
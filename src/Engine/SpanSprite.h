@@ -0,0 +1,83 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_SPANSPRITE_H
+#define OPENXCOM_SPANSPRITE_H
+
+#include <vector>
+#include <SDL.h>
+
+namespace OpenXcom
+{
+
+class Surface;
+
+/**
+ * A sprite kept as the runs of opaque pixels on each of its rows.
+ * Drawing it copies whole runs and skips the transparent pixels
+ * between them, instead of testing every pixel of the sprite.
+ */
+class SpanSprite
+{
+private:
+	/// A run of opaque pixels on a row.
+	struct Span
+	{
+		Uint16 x, length;
+		int offset;
+	};
+	int _width, _height;
+	std::vector<Span> _spans;
+	/// Index of the first span of each row, and the end of the last row.
+	std::vector<int> _rows;
+	std::vector<Uint8> _pixels;
+public:
+	/// Creates a span sprite from the opaque pixels of a surface.
+	SpanSprite(Surface *surface);
+	/// Cleans up the span sprite.
+	~SpanSprite();
+	/// Changes every opaque pixel with a color function.
+	template<typename ColorFunc>
+	void apply(int arg0, int arg1);
+	/// Copies the sprite onto a surface.
+	void blit(Surface *surface, int x, int y, bool half = false) const;
+	/// Gets the memory used by the sprite.
+	size_t getSize() const;
+};
+
+/**
+ * Changes every opaque pixel of the sprite with the `func` of a color
+ * function, as ShaderDraw would when drawing the sprite onto itself.
+ * @tparam ColorFunc class with a static `func` like the ones used by ShaderDraw.
+ * @param arg0 First argument of the color function.
+ * @param arg1 Second argument of the color function.
+ */
+template<typename ColorFunc>
+void SpanSprite::apply(int arg0, int arg1)
+{
+	const int unused = 0;
+	for (std::vector<Uint8>::iterator i = _pixels.begin(); i != _pixels.end(); ++i)
+	{
+		const Uint8 src = *i;
+		ColorFunc::func(*i, src, arg0, arg1, unused);
+	}
+}
+
+}
+
+#endif
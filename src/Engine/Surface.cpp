@@ -23,6 +23,9 @@
 #include "Palette.h"
 #include "Exception.h"
 #include "ShaderMove.h"
+#include "ShadeCache.h"
+#include "SpanSprite.h"
+#include "ShadeRow.h"
 
 namespace OpenXcom
 {
@@ -38,7 +41,7 @@ namespace OpenXcom
  * @param x X position in pixels.
  * @param y Y position in pixels.
  */
-Surface::Surface(int width, int height, int x, int y) : _x(x), _y(y), _visible(true), _hidden(false), _redraw(false), _originalColors(0)
+Surface::Surface(int width, int height, int x, int y) : _x(x), _y(y), _visible(true), _hidden(false), _redraw(false), _originalColors(0), _spans(0)
 {
 	_surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 8, 0, 0, 0, 0);
 
@@ -72,6 +75,7 @@ Surface::Surface(const Surface& other)
 	_hidden = other._hidden;
 	_redraw = other._redraw;
 	_originalColors = other._originalColors;
+	_spans = other._spans? new SpanSprite(*other._spans) : 0;
 }
 
 /**
@@ -79,6 +83,11 @@ Surface::Surface(const Surface& other)
  */
 Surface::~Surface()
 {
+	if (_spans)
+	{
+		ShadeCache::remove(this);
+		delete _spans;
+	}
 	SDL_FreeSurface(_surface);
 }
 
@@ -664,71 +673,56 @@ void Surface::paletteRestore()
 	}
 }
 
+namespace helper
+{
+
 /**
- * help class used for Surface::blitNShade
+ * Draws rows of Surface::blitNShade with ColorReplace through shadeRow.
  */
-struct ColorReplace
+template<>
+struct row_drawer<ColorReplace, ShaderMove<Uint8>, ShaderMove<Uint8>, Scalar<int>, Scalar<int>, Nothing>
 {
-	
-	/**
-	* Function used by ShaderDraw in Surface::blitNShade
-	* set shade and replace color in that surface
-	* @param dest destination pixel
-	* @param src source pixel
-	* @param shade value of shade of this surface
-	* @param newColor new color to set (it should be offseted by 4)
-	* @param notused
-	*/
-	static inline void func(Uint8& dest, const Uint8& src, const int& shade, const int& newColor, const int&)
+	static inline void draw(controler<ShaderMove<Uint8> >& dest, controler<ShaderMove<Uint8> >& src0, controler<Scalar<int> >& src1, controler<Scalar<int> >& src2, controler<Nothing>&, int count)
 	{
-		if(src)
+		Uint8 *d = dest.ptr_pos_x;
+		const Uint8 *s = src0.ptr_pos_x;
+		const int shade = src1.get_ref(), newColor = src2.get_ref();
+		for (int x = shadeRow(d, s, count, shade, newColor); x < count; ++x)
 		{
-			const int newShade = (src&15) + shade;
-			if (newShade > 15)
-				// so dark it would flip over to another color - make it black instead
-				dest = 15;
-			else
-				dest = newColor | newShade;
+			ColorReplace::func(d[x], s[x], shade, newColor, 0);
 		}
 	}
-	
 };
 
 /**
- * help class used for Surface::blitNShade
+ * Draws rows of Surface::blitNShade with StandartShade through shadeRow.
  */
-struct StandartShade
+template<>
+struct row_drawer<StandartShade, ShaderMove<Uint8>, ShaderMove<Uint8>, Scalar<int>, Nothing, Nothing>
 {
-	/**
-	* Function used by ShaderDraw in Surface::blitNShade
-	* set shade
-	* @param dest destination pixel
-	* @param src source pixel
-	* @param shade value of shade of this surface
-	* @param notused
-	* @param notused
-	*/
-	static inline void func(Uint8& dest, const Uint8& src, const int& shade, const int&, const int&)
+	static inline void draw(controler<ShaderMove<Uint8> >& dest, controler<ShaderMove<Uint8> >& src0, controler<Scalar<int> >& src1, controler<Nothing>&, controler<Nothing>&, int count)
 	{
-		if(src)
+		Uint8 *d = dest.ptr_pos_x;
+		const Uint8 *s = src0.ptr_pos_x;
+		const int shade = src1.get_ref();
+		for (int x = shadeRow(d, s, count, shade, -1); x < count; ++x)
 		{
-			const int newShade = (src&15) + shade;
-			if (newShade > 15)
-				// so dark it would flip over to another color - make it black instead
-				dest = 15;
-			else
-				dest = (src&(15<<4)) | newShade;
+			StandartShade::func(d[x], s[x], shade, 0, 0);
 		}
 	}
-	
 };
 
+}//namespace helper
+
 
 
 /**
  * Specific blit function to blit battlescape terrain data in different shades in a fast way.
  * Notice there is no surface locking here - you have to make sure you lock the surface yourself
  * at the start of blitting and unlock it when done.
+ * Like SDL blits, this keeps within the clipping rectangle of the target surface.
+ * Surfaces with opaque spans are drawn straight from them: unshaded they are just copied,
+ * otherwise they are shaded once per shade and color and the copy is kept in the ShadeCache.
  * @param surface to blit to
  * @param x
  * @param y
@@ -738,7 +732,28 @@ struct StandartShade
  */
 void Surface::blitNShade(Surface *surface, int x, int y, int off, bool half, int newBaseColor)
 {
+	if (_spans)
+	{
+		// with no shade and no new color every pixel stays the same
+		SpanSprite *sprite = (off == 0 && newBaseColor == 0)? _spans : ShadeCache::get(this, off, newBaseColor);
+		if (!sprite)
+		{
+			sprite = new SpanSprite(*_spans);
+			if (newBaseColor)
+				sprite->apply<ColorReplace>(off, (newBaseColor - 1) << 4);
+			else
+				sprite->apply<StandartShade>(off, 0);
+			ShadeCache::add(this, off, newBaseColor, sprite);
+		}
+		// same placement as the shader below, which moves the target by its own position
+		sprite->blit(surface, x - surface->getX(), y - surface->getY(), half);
+		return;
+	}
+
 	ShaderMove<Uint8> src(this, x, y);
+	ShaderMove<Uint8> dest(surface);
+	const SDL_Rect &clip = surface->getSurface()->clip_rect;
+	dest.setDomain(GraphSubset(std::make_pair((int)clip.x, clip.x + clip.w), std::make_pair((int)clip.y, clip.y + clip.h)));
 	if(half)
 	{
 		GraphSubset g = src.getDomain();
@@ -749,10 +764,10 @@ void Surface::blitNShade(Surface *surface, int x, int y, int off, bool half, int
 	{
 		--newBaseColor;
 		newBaseColor <<= 4;
-		ShaderDraw<ColorReplace>(ShaderSurface(surface), src, ShaderScalar(off), ShaderScalar(newBaseColor));
+		ShaderDraw<ColorReplace>(dest, src, ShaderScalar(off), ShaderScalar(newBaseColor));
 	}
 	else
-		ShaderDraw<StandartShade>(ShaderSurface(surface), src, ShaderScalar(off));
+		ShaderDraw<StandartShade>(dest, src, ShaderScalar(off));
 		
 }
 
@@ -763,4 +778,21 @@ void Surface::invalidate()
 {
 	_redraw = true;
 }
+
+/**
+ * Gives the surface the runs of opaque pixels on its rows, which blitNShade
+ * draws from instead of the pixels, and keeps shaded copies of in the ShadeCache.
+ * Only use this for surfaces whose pixels never change afterwards, like loaded sprites.
+ * @param spans Pointer to the spans of the surface, deleted along with it, or 0 for none.
+ */
+void Surface::setSpans(SpanSprite *spans)
+{
+	if (_spans)
+	{
+		ShadeCache::remove(this);
+		delete _spans;
+	}
+	_spans = spans;
+}
+
 }
@@ -25,6 +25,8 @@
 namespace OpenXcom
 {
 
+class SpanSprite;
+
 /**
  * Element that is blit (rendered) onto the screen.
  * Mainly an encapsulation for SDL's SDL_Surface struct, so it
@@ -40,6 +42,7 @@ protected:
 	SDL_Rect _crop;
 	bool _visible, _hidden, _redraw;
 	SDL_Color *_originalColors;
+	SpanSprite *_spans;
 public:
 	/// Creates a new surface with the specified size and position.
 	Surface(int width, int height, int x = 0, int y = 0);
@@ -123,6 +126,8 @@ public:
 	void blitNShade(Surface *surface, int x, int y, int off, bool half = false, int newBaseColor = 0);
 	/// Invalidate the surface: force it to be redrawn
 	void invalidate();
+	/// Keeps the opaque spans of the surface, for surfaces that never change.
+	void setSpans(SpanSprite *spans);
 };
 
 }
@@ -19,6 +19,7 @@
 #include "SurfaceSet.h"
 #include <fstream>
 #include "Surface.h"
+#include "SpanSprite.h"
 #include "Exception.h"
 
 namespace OpenXcom
@@ -104,38 +105,44 @@ void SurfaceSet::loadPck(const std::string &pck, const std::string &tab)
 
 	for (int frame = 0; frame < nframes; frame++)
 	{
+		SDL_Surface *surface = _frames[frame]->getSurface();
 		int x = 0, y = 0;
 
 		// Lock the surface
 		_frames[frame]->lock();
+		_frames[frame]->clear();
+		Uint8 *pixels = (Uint8*)surface->pixels;
 
+		// the frame starts with its number of empty rows, transparent runs are just skipped
 		imgFile.read((char*)&value, 1);
-		for (int i = 0; i < value; ++i)
-		{
-			for (int j = 0; j < _width; ++j)
-			{
-				_frames[frame]->setPixelIterative(&x, &y, 0);
-			}
-		}
+		y = value;
 
 		while (imgFile.read((char*)&value, 1) && value != 255)
 		{
 			if (value == 254)
 			{
 				imgFile.read((char*)&value, 1);
-				for (int i = 0; i < value; ++i)
+				x += value;
+			}
+			else
+			{
+				if (y < _height)
 				{
-					_frames[frame]->setPixelIterative(&x, &y, 0);
+					pixels[y * surface->pitch + x] = value;
 				}
+				x++;
 			}
-			else
+			while (x >= _width)
 			{
-				_frames[frame]->setPixelIterative(&x, &y, value);
+				x -= _width;
+				y++;
 			}
 		}
 
 		// Unlock the surface
 		_frames[frame]->unlock();
+		// the sprites don't change after loading, so they can be drawn from their opaque spans
+		_frames[frame]->setSpans(new SpanSprite(_frames[frame]));
 	}
 
 	imgFile.close();
@@ -199,6 +206,11 @@ void SurfaceSet::loadDat(const std::string &filename)
 		}
 	}
 
+	for (std::vector<Surface*>::iterator i = _frames.begin(); i != _frames.end(); ++i)
+	{
+		(*i)->setSpans(new SpanSprite(*i));
+	}
+
 	imgFile.close();
 }
 
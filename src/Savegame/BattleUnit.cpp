@@ -33,6 +33,7 @@
 #include "../Ruleset/RuleSoldier.h"
 #include "Tile.h"
 #include "SavedGame.h"
+#include "UnitGrid.h"
 
 namespace OpenXcom
 {
@@ -42,7 +43,7 @@ namespace OpenXcom
  * @param soldier Pointer to the Soldier.
  * @param faction Which faction the units belongs to.
  */
-BattleUnit::BattleUnit(Soldier *soldier, UnitFaction faction) : _geoscapeSoldier(soldier), _faction(faction), _originalFaction(faction), _id(0), _pos(Position()), _tile(0), _lastPos(Position()), _direction(0), _directionTurret(0), _toDirectionTurret(0),  _verticalDirection(0), _status(STATUS_STANDING), _walkPhase(0), _fallPhase(0), _kneeled(false), _floating(false), _dontReselect(false), _fire(0), _currentAIState(0), _visible(false), _cacheInvalid(true), _expBravery(0), _expReactions(0), _expFiring(0), _expThrowing(0), _expPsiSkill(0), _expMelee(0), _turretType(-1), _motionPoints(0), _kills(0)
+BattleUnit::BattleUnit(Soldier *soldier, UnitFaction faction) : _geoscapeSoldier(soldier), _faction(faction), _originalFaction(faction), _id(0), _pos(Position()), _tile(0), _lastPos(Position()), _direction(0), _directionTurret(0), _toDirectionTurret(0),  _verticalDirection(0), _status(STATUS_STANDING), _walkPhase(0), _fallPhase(0), _kneeled(false), _floating(false), _dontReselect(false), _fire(0), _currentAIState(0), _visible(false), _cacheInvalid(true), _fovDirection(0), _fovCached(false), _grid(0), _expBravery(0), _expReactions(0), _expFiring(0), _expThrowing(0), _expPsiSkill(0), _expMelee(0), _turretType(-1), _motionPoints(0), _kills(0)
 {
 	_name = soldier->getName();
 	_id = soldier->getId();
@@ -96,7 +97,7 @@ BattleUnit::BattleUnit(Soldier *soldier, UnitFaction faction) : _geoscapeSoldier
  * @param unit Pointer to Unit object.
  * @param faction Which faction the units belongs to.
  */
-BattleUnit::BattleUnit(Unit *unit, UnitFaction faction, int id, Armor *armor) : _geoscapeSoldier(0), _faction(faction), _originalFaction(faction), _id(id), _pos(Position()), _tile(0), _lastPos(Position()), _direction(0), _directionTurret(0), _toDirectionTurret(0),  _verticalDirection(0), _status(STATUS_STANDING), _walkPhase(0), _fallPhase(0), _kneeled(false), _floating(false), _dontReselect(false), _fire(0), _currentAIState(0), _visible(false), _cacheInvalid(true), _expBravery(0), _expReactions(0), _expFiring(0), _expThrowing(0), _expPsiSkill(0), _expMelee(0), _turretType(-1), _motionPoints(0), _kills(0), _armor(armor)
+BattleUnit::BattleUnit(Unit *unit, UnitFaction faction, int id, Armor *armor) : _geoscapeSoldier(0), _faction(faction), _originalFaction(faction), _id(id), _pos(Position()), _tile(0), _lastPos(Position()), _direction(0), _directionTurret(0), _toDirectionTurret(0),  _verticalDirection(0), _status(STATUS_STANDING), _walkPhase(0), _fallPhase(0), _kneeled(false), _floating(false), _dontReselect(false), _fire(0), _currentAIState(0), _visible(false), _cacheInvalid(true), _fovDirection(0), _fovCached(false), _grid(0), _expBravery(0), _expReactions(0), _expFiring(0), _expThrowing(0), _expPsiSkill(0), _expMelee(0), _turretType(-1), _motionPoints(0), _kills(0), _armor(armor)
 {
 	_type = unit->getType();
 	_rank = unit->getRank();
@@ -250,6 +251,7 @@ void BattleUnit::setPosition(const Position& pos)
 {
 	_lastPos = _pos;
 	_pos = pos;
+	if (_grid) _grid->moveUnit(this, _lastPos);
 }
 
 /**
@@ -392,7 +394,9 @@ void BattleUnit::keepWalking()
 	{
 		// we assume we reached our destination tile
 		// this is actually a drawing hack, so soldiers are not overlapped by floortiles
+		Position from = _pos;
 		_pos = _destination;
+		if (_grid) _grid->moveUnit(this, from);
 	}
 
 	if (_walkPhase == end)
@@ -595,6 +599,15 @@ UnitFaction BattleUnit::getFaction() const
 	return _faction;
 }
 
+/**
+ * Returns the faction the unit belonged to before it was mind controlled.
+ * @return Faction. (player, hostile or neutral)
+ */
+UnitFaction BattleUnit::getOriginalFaction() const
+{
+	return _originalFaction;
+}
+
 /**
  * Sets the unit's cache flag.
  * Set to true when the unit has to be redrawn from scratch.
@@ -1063,6 +1076,32 @@ void BattleUnit::clearVisibleTiles()
 	}
 
 	_visibleTiles.clear();
+	_fovCached = false;
+}
+
+/**
+ * Marks the visible tiles as calculated from the unit's current position and direction,
+ * or marks them as outdated so the next FOV calculation does a full rescan.
+ * @param cached Whether the visible tiles are up to date.
+ */
+void BattleUnit::setFOVCache(bool cached)
+{
+	_fovCached = cached;
+	_fovPosition = _pos;
+	_fovDirection = _direction;
+}
+
+/**
+ * Gets the position and direction the visible tiles were last calculated from.
+ * @param position Receives the position.
+ * @param direction Receives the direction.
+ * @return Whether the visible tiles are still valid for that position and direction.
+ */
+bool BattleUnit::getFOVCache(Position *position, int *direction) const
+{
+	*position = _fovPosition;
+	*direction = _fovDirection;
+	return _fovCached;
 }
 
 /**
@@ -1347,6 +1386,10 @@ BattleAIState *BattleUnit::getCurrentAIState() const
  */
 void BattleUnit::setVisible(bool flag)
 {
+	if (_visible != flag && _tile)
+	{
+		_tile->invalidate();
+	}
 	_visible = flag;
 }
 
@@ -1388,6 +1431,24 @@ void BattleUnit::setTile(Tile *tile)
 	}
 }
 
+/**
+ * Sets the grid that keeps track of where the unit is. The grid is told every time the unit changes position.
+ * @param grid Pointer to the unit grid.
+ */
+void BattleUnit::setUnitGrid(UnitGrid *grid)
+{
+	_grid = grid;
+}
+
+/**
+ * Gets the grid that keeps track of where the unit is.
+ * @return Pointer to the unit grid, 0 if the unit isn't on it yet.
+ */
+UnitGrid *BattleUnit::getUnitGrid() const
+{
+	return _grid;
+}
+
 /**
  * Gets the unit's tile.
  * @return Tile
@@ -40,6 +40,7 @@ class Surface;
 class RuleInventory;
 class Soldier;
 class Armor;
+class UnitGrid;
 class SavedGame;
 class Language;
 
@@ -79,6 +80,10 @@ private:
 	bool _visible;
 	Surface *_cache[5];
 	bool _cacheInvalid;
+	Position _fovPosition;
+	int _fovDirection;
+	bool _fovCached;
+	UnitGrid *_grid;
 	int _expBravery, _expReactions, _expFiring, _expThrowing, _expPsiSkill, _expMelee;
 	int improveStat(int exp);
 	int _turretType;
@@ -152,6 +157,8 @@ public:
 	SoldierGender getGender() const;
 	/// Gets the unit's faction.
 	UnitFaction getFaction() const;
+	/// Gets the faction the unit goes back to at the start of its turn.
+	UnitFaction getOriginalFaction() const;
 	/// Set the cached flag.
 	void setCache(Surface *cache, int part = 0);
 	/// If this unit is cached on the battlescape.
@@ -206,6 +213,10 @@ public:
 	std::vector<Tile*> *const getVisibleTiles();
 	/// Clear visible tiles.
 	void clearVisibleTiles();
+	/// Remember where the visible tiles were calculated from.
+	void setFOVCache(bool cached);
+	/// Get where the visible tiles were calculated from.
+	bool getFOVCache(Position *position, int *direction) const;
 	/// Calculate firing accuracy.
 	double getFiringAccuracy(BattleActionType actionType, BattleItem *item);
 	/// Calculate accuracy modifier.
@@ -246,6 +257,10 @@ public:
 	bool getVisible() const;
 	/// Sets the unit's tile it's standing on
 	void setTile(Tile *tile);
+	/// Set the grid that keeps track of where the unit is.
+	void setUnitGrid(UnitGrid *grid);
+	/// Gets the grid that keeps track of where the unit is.
+	UnitGrid *getUnitGrid() const;
 	/// Gets the unit's tile.
 	Tile *getTile() const;
 	/// Gets the item in the specified slot.
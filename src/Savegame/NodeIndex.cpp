@@ -0,0 +1,168 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "NodeIndex.h"
+#include "Node.h"
+
+namespace OpenXcom
+{
+
+/**
+ * Orders spawn nodes by priority, highest first.
+ */
+struct HigherPriority
+{
+	bool operator()(const Node *a, const Node *b) const
+	{
+		return a->getPriority() > b->getPriority();
+	}
+};
+
+/**
+ * Sets up an empty node index.
+ * @param mapWidth Width of the map in tiles.
+ * @param mapLength Length of the map in tiles.
+ * @param nodes Pointer to the node list of the battle.
+ */
+NodeIndex::NodeIndex(int mapWidth, int mapLength, std::vector<Node*> *nodes) : _nodes(nodes), _indexed(0)
+{
+	_width = (mapWidth + CELL_SIZE - 1) / CELL_SIZE;
+	_length = (mapLength + CELL_SIZE - 1) / CELL_SIZE;
+	if (_width < 1) _width = 1;
+	if (_length < 1) _length = 1;
+	_cells.resize(_width * _length);
+}
+
+/**
+ * Deletes the node index.
+ */
+NodeIndex::~NodeIndex()
+{
+
+}
+
+/**
+ * Gets the cell a position falls in. Positions off the map are kept in the nearest cell.
+ * @param position Tile position.
+ * @return Cell index.
+ */
+int NodeIndex::getCell(const Position &position) const
+{
+	int x = std::max(0, std::min(position.x / CELL_SIZE, _width - 1));
+	int y = std::max(0, std::min(position.y / CELL_SIZE, _length - 1));
+	return y * _width + x;
+}
+
+/**
+ * Makes the index again if nodes were added to the battle since it was made.
+ */
+void NodeIndex::update()
+{
+	if (_indexed == _nodes->size())
+		return;
+
+	for (std::vector<std::vector<size_t> >::iterator i = _cells.begin(); i != _cells.end(); ++i)
+	{
+		i->clear();
+	}
+	_spawnNodes.clear();
+	for (size_t i = 0; i < _nodes->size(); ++i)
+	{
+		Node *node = _nodes->at(i);
+		_cells[getCell(node->getPosition())].push_back(i);
+		// priority 0 is no spawnplace
+		if (node->getPriority() > 0)
+		{
+			if ((size_t)node->getRank() >= _spawnNodes.size())
+				_spawnNodes.resize(node->getRank() + 1);
+			_spawnNodes[node->getRank()].push_back(node);
+		}
+	}
+	for (std::vector<std::vector<Node*> >::iterator i = _spawnNodes.begin(); i != _spawnNodes.end(); ++i)
+	{
+		// nodes of the same priority stay in the order of the node list
+		std::stable_sort(i->begin(), i->end(), HigherPriority());
+	}
+	_indexed = _nodes->size();
+}
+
+/**
+ * Gets the node closest to a position, by the distance over the ground as TileEngine::distance measures it.
+ * The cells are searched in rings around the position, until no node in the next ring could be as close.
+ * Of nodes at the same distance, the first in the node list is chosen.
+ * @param position The position.
+ * @return Pointer to the node, or 0 if there are no nodes.
+ */
+Node *NodeIndex::getClosestNode(const Position &position)
+{
+	update();
+
+	int cell = getCell(position);
+	int cx = cell % _width, cy = cell / _width;
+	int closest = -1;
+	size_t closestIndex = 0;
+	for (int ring = 0; ring < std::max(_width, _length); ++ring)
+	{
+		// nodes in this ring are at least this far along one axis
+		if (closest != -1 && (ring - 1) * CELL_SIZE + 1 > closest)
+			break;
+		for (int y = cy - ring; y <= cy + ring; ++y)
+		{
+			for (int x = cx - ring; x <= cx + ring; ++x)
+			{
+				if (x < 0 || y < 0 || x >= _width || y >= _length || (std::abs(x - cx) != ring && std::abs(y - cy) != ring))
+					continue;
+				const std::vector<size_t> &nodes = _cells[y * _width + x];
+				for (std::vector<size_t>::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
+				{
+					const Position &pos = _nodes->at(*i)->getPosition();
+					int dx = pos.x - position.x, dy = pos.y - position.y;
+					int d = int(floor(sqrt(float(dx*dx + dy*dy)) + 0.5));
+					if (closest == -1 || d < closest || (d == closest && *i < closestIndex))
+					{
+						closest = d;
+						closestIndex = *i;
+					}
+				}
+			}
+		}
+	}
+	return closest == -1 ? 0 : _nodes->at(closestIndex);
+}
+
+/**
+ * Gets the nodes units can spawn at for a rank, highest priority first.
+ * Nodes of the same priority are in the order of the node list.
+ * @param rank Rank of the node.
+ * @return The nodes.
+ */
+const std::vector<Node*> &NodeIndex::getSpawnNodes(int rank)
+{
+	update();
+	if (rank < 0 || (size_t)rank >= _spawnNodes.size())
+	{
+		static const std::vector<Node*> none;
+		return none;
+	}
+	return _spawnNodes[rank];
+}
+
+}
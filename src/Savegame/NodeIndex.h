@@ -0,0 +1,61 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_NODEINDEX_H
+#define OPENXCOM_NODEINDEX_H
+
+#include <vector>
+#include "../Battlescape/Position.h"
+
+namespace OpenXcom
+{
+
+class Node;
+
+/**
+ * Looks up the nodes of a battle by map area and by rank, so the AI doesn't have to go
+ * through all of them. Nodes don't move, so the index is made once, when first used
+ * after nodes were added.
+ */
+class NodeIndex
+{
+private:
+	static const int CELL_SIZE = 10;
+	int _width, _length;
+	std::vector<Node*> *_nodes;
+	size_t _indexed;
+	/// Places in the node list of the nodes in each cell.
+	std::vector<std::vector<size_t> > _cells;
+	/// Nodes units can spawn at, for each rank, highest priority first.
+	std::vector<std::vector<Node*> > _spawnNodes;
+	int getCell(const Position &position) const;
+	void update();
+public:
+	/// Creates a node index for a map.
+	NodeIndex(int mapWidth, int mapLength, std::vector<Node*> *nodes);
+	/// Cleans up the node index.
+	~NodeIndex();
+	/// Gets the node closest to a position.
+	Node *getClosestNode(const Position &position);
+	/// Gets the nodes units can spawn at for a rank.
+	const std::vector<Node*> &getSpawnNodes(int rank);
+};
+
+}
+
+#endif
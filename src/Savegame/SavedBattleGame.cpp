@@ -21,10 +21,14 @@
 #include "SavedGame.h"
 #include "Tile.h"
 #include "Node.h"
+#include "UnitGrid.h"
+#include "NodeIndex.h"
+#include <algorithm>
 #include <SDL.h>
 #include "../Ruleset/MapDataSet.h"
 #include "../Battlescape/Pathfinding.h"
 #include "../Battlescape/TileEngine.h"
+#include "../Battlescape/ThreatMap.h"
 #include "../Battlescape/Position.h"
 #include "../Resource/ResourcePack.h"
 #include "../Ruleset/Ruleset.h"
@@ -44,7 +48,7 @@ namespace OpenXcom
 /**
  * Initializes a brand new battlescape saved game.
  */
-SavedBattleGame::SavedBattleGame() : _width(0), _length(0), _height(0), _tiles(), _selectedUnit(0), _lastSelectedUnit(0), _nodes(), _units(), _items(), _pathfinding(0), _tileEngine(0), _missionType(""), _globalShade(0), _side(FACTION_PLAYER), _turn(1), _debugMode(false), _aborted(false), _itemId(0)
+SavedBattleGame::SavedBattleGame() : _width(0), _length(0), _height(0), _tiles(), _selectedUnit(0), _lastSelectedUnit(0), _nodes(), _units(), _items(), _pathfinding(0), _tileEngine(0), _unitGrid(0), _threatMap(0), _nodeIndex(0), _missionType(""), _globalShade(0), _side(FACTION_PLAYER), _turn(1), _debugMode(false), _aborted(false), _itemId(0)
 {
 	std::string temp;
 	temp = Options::getString("battleScrollButton");
@@ -85,6 +89,9 @@ SavedBattleGame::~SavedBattleGame()
 
 	delete _pathfinding;
 	delete _tileEngine;
+	delete _unitGrid;
+	delete _threatMap;
+	delete _nodeIndex;
 }
 
 /**
@@ -272,6 +279,7 @@ void SavedBattleGame::loadMapResources(ResourcePack *res)
 	}
 
 	initUtilities(res);
+	getTileEngine()->calculateVoxelPlanes();
 	getTileEngine()->calculateSunShading();
 	getTileEngine()->calculateTerrainLighting();
 	getTileEngine()->calculateUnitLighting();
@@ -382,6 +390,9 @@ void SavedBattleGame::initUtilities(ResourcePack *res)
 {
 	_pathfinding = new Pathfinding(this);
 	_tileEngine = new TileEngine(this, res->getVoxelData());
+	_unitGrid = new UnitGrid(_width, _length, &_units);
+	_threatMap = new ThreatMap(this);
+	_nodeIndex = new NodeIndex(_width, _length, &_nodes);
 }
 
 /**
@@ -666,6 +677,33 @@ TileEngine *const SavedBattleGame::getTileEngine() const
 	return _tileEngine;
 }
 
+/**
+ * Get the grid that finds units by position.
+ * @return pointer to the unit grid
+ */
+UnitGrid *const SavedBattleGame::getUnitGrid() const
+{
+	return _unitGrid;
+}
+
+/**
+ * Get the map of the tiles known enemies can see.
+ * @return pointer to the threat map
+ */
+ThreatMap *const SavedBattleGame::getThreatMap() const
+{
+	return _threatMap;
+}
+
+/**
+ * Get the index that finds nodes by position and rank.
+ * @return pointer to the node index
+ */
+NodeIndex *const SavedBattleGame::getNodeIndex() const
+{
+	return _nodeIndex;
+}
+
 /**
 * gets a pointer to the array of mapblock
 * @return pointer to the array of mapblocks
@@ -693,6 +731,43 @@ int SavedBattleGame::getTurn() const
 	return _turn;
 }
 
+/**
+ * Gets a hash of the turn and of where every unit is and how it's doing.
+ * Playing the same save the same way gives the same hash, so it shows when a change
+ * meant to make the battlescape faster changes what happens in it.
+ * @return FNV-1a hash.
+ */
+unsigned int SavedBattleGame::getStateHash() const
+{
+	unsigned int hash = 2166136261u;
+	std::vector<int> values;
+	values.push_back(_turn);
+	for (std::vector<BattleUnit*>::const_iterator i = _units.begin(); i != _units.end(); ++i)
+	{
+		values.push_back((*i)->getId());
+		values.push_back((*i)->getPosition().x);
+		values.push_back((*i)->getPosition().y);
+		values.push_back((*i)->getPosition().z);
+		values.push_back((*i)->getDirection());
+		values.push_back((*i)->getStatus());
+		values.push_back((*i)->getFaction());
+		values.push_back((*i)->getHealth());
+		values.push_back((*i)->getStunlevel());
+		values.push_back((*i)->getTimeUnits());
+		values.push_back((*i)->getEnergy());
+		values.push_back((*i)->getMorale());
+	}
+	for (std::vector<int>::const_iterator i = values.begin(); i != values.end(); ++i)
+	{
+		for (int byte = 0; byte < 4; ++byte)
+		{
+			hash ^= (*i >> (byte * 8)) & 0xFF;
+			hash *= 16777619u;
+		}
+	}
+	return hash;
+}
+
 /**
  * Ends the current turn and progresses to the next one.
  */
@@ -739,15 +814,25 @@ void SavedBattleGame::endTurn()
 		}
 	}
 
+	// each unit prepares for the new turn just before its FOV is calculated; the only thing the
+	// units before it could notice is a mind controlled unit going back, so only wait for those
+	std::vector<BattleUnit*> units;
 	for (std::vector<BattleUnit*>::iterator i = _units.begin(); i != _units.end(); ++i)
 	{
 		if ((*i)->getFaction() == _side)
 		{
+			if ((*i)->getFaction() != (*i)->getOriginalFaction())
+			{
+				_tileEngine->calculateFOV(units);
+				units.clear();
+			}
 			(*i)->prepareNewTurn();
 		}
-		_tileEngine->calculateFOV(*i);
+		units.push_back(*i);
 	}
 
+	_tileEngine->calculateFOV(units);
+
 	if (_side != FACTION_PLAYER)
 		selectNextPlayerUnit();
 }
@@ -871,27 +956,21 @@ int *SavedBattleGame::getCurrentItemId()
 Node *SavedBattleGame::getSpawnNode(int nodeRank, BattleUnit *unit)
 {
 	int highestPriority = -1;
-	std::vector<Node*> compliantNodes;	
+	std::vector<Node*> compliantNodes;
+	// the spawn nodes of the rank come highest priority first
+	const std::vector<Node*> &nodes = _nodeIndex->getSpawnNodes(nodeRank);
 
-	for (std::vector<Node*>::iterator i = getNodes()->begin(); i != getNodes()->end(); ++i)
+	for (std::vector<Node*>::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
 	{
-		if ((*i)->getRank() == nodeRank										// ranks must match
-			&& (!((*i)->getType() & Node::TYPE_SMALL) 
+		if ((*i)->getPriority() < highestPriority) break; // only lower priorities left
+		if ((!((*i)->getType() & Node::TYPE_SMALL) 
 				|| unit->getArmor()->getSize() == 1)				// the small unit bit is not set or the unit is small
 			&& (!((*i)->getType() & Node::TYPE_FLYING) 
 				|| unit->getArmor()->getMovementType() == MT_FLY)// the flying unit bit is not set or the unit can fly
-			&& (*i)->getPriority() > 0										// priority 0 is no spawnplace
 			&& setUnitPosition(unit, (*i)->getPosition(), true))	// check if not already occupied
 		{
-			if ((*i)->getPriority() > highestPriority)
-			{
-				highestPriority = (*i)->getPriority();
-				compliantNodes.clear(); // drop the last nodes, as we found a higher priority now
-			}
-			if ((*i)->getPriority() == highestPriority)
-			{
-				compliantNodes.push_back((*i));
-			}
+			highestPriority = (*i)->getPriority();
+			compliantNodes.push_back((*i));
 		}
 	}
 	
@@ -1038,9 +1117,12 @@ void SavedBattleGame::prepareNewTurn()
 		(*i)->prepareNewTurn();
 	}
 
-	if (!tilesOnFire.empty())
+	// burnt out fires destroy what was burning, fires could have been stopped or spread to the tiles around
+	for (std::vector<Tile*>::iterator i = tilesOnFire.begin(); i != tilesOnFire.end(); ++i)
 	{
-		getTileEngine()->calculateTerrainLighting(); // fires could have been stopped
+		const Position &pos = (*i)->getPosition();
+		getTileEngine()->invalidateTerrain(pos);
+		getTileEngine()->calculateTerrainLighting(std::max(pos.x - 1, 0), std::max(pos.y - 1, 0), std::min(pos.x + 1, _width - 1), std::min(pos.y + 1, _length - 1));
 	}
 
 	reviveUnconsciousUnits();
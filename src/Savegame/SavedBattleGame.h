@@ -42,6 +42,9 @@ class Soldier;
 class Position;
 class Pathfinding;
 class TileEngine;
+class UnitGrid;
+class ThreatMap;
+class NodeIndex;
 class BattleItem;
 class Item;
 class RuleInventory;
@@ -64,6 +67,9 @@ private:
 	std::vector<BattleItem*> _items;
 	Pathfinding *_pathfinding;
 	TileEngine *_tileEngine;
+	UnitGrid *_unitGrid;
+	ThreatMap *_threatMap;
+	NodeIndex *_nodeIndex;
 	std::string _missionType;
 	int _globalShade;
 	UnitFaction _side;
@@ -134,10 +140,18 @@ public:
 	Pathfinding *const getPathfinding() const;
 	/// get a pointer to the tileengine
 	TileEngine *const getTileEngine() const;
+	/// get a pointer to the unit grid
+	UnitGrid *const getUnitGrid() const;
+	/// get a pointer to the threat map
+	ThreatMap *const getThreatMap() const;
+	/// get a pointer to the node index
+	NodeIndex *const getNodeIndex() const;
 	/// get the playing side
 	UnitFaction getSide() const;
 	/// get the turn number
 	int getTurn() const;
+	/// Get a hash of the state of the units.
+	unsigned int getStateHash() const;
 	/// end the turn
 	void endTurn();
 	/// set debug mode
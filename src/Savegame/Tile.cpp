@@ -24,6 +24,7 @@
 #include "../Engine/RNG.h"
 #include "../Engine/Exception.h"
 #include "BattleUnit.h"
+#include "UnitGrid.h"
 #include "BattleItem.h"
 #include "../Ruleset/RuleItem.h"
 
@@ -34,7 +35,7 @@ namespace OpenXcom
 * constructor
 * @param pos Position.
 */
-Tile::Tile(const Position& pos): _smoke(0), _fire(0),  _explosive(0), _pos(pos), _unit(0), _animationOffset(0), _markerColor(0), _visible(false)
+Tile::Tile(const Position& pos): _smoke(0), _fire(0),  _explosive(0), _pos(pos), _unit(0), _animationOffset(0), _markerColor(0), _visible(false), _invalid(true)
 {
 	for (int i = 0; i < 4; ++i)
 	{
@@ -42,11 +43,11 @@ Tile::Tile(const Position& pos): _smoke(0), _fire(0),  _explosive(0), _pos(pos),
 		_mapDataID[i] = -1;
 		_mapDataSetID[i] = -1;
 		_currentFrame[i] = 0;
+		updateBlockage(i);
 	}
 	for (int layer = 0; layer < LIGHTLAYERS; layer++)
 	{
 		_light[layer] = 0;
-		_lastLight[layer] = -1;
 	}
 	for (int i = 0; i < 3; ++i)
 	{
@@ -125,6 +126,31 @@ void Tile::setMapData(MapData *dat, int mapDataID, int mapDataSetID, int part)
 	_objects[part] = dat;
 	_mapDataID[part] = mapDataID;
 	_mapDataSetID[part] = mapDataSetID;
+	updateBlockage(part);
+	_invalid = true;
+}
+
+/**
+ * Caches the blockage and TU costs of a part of the tile, so they can be read without going through the mapdata.
+ * Needs to be called whenever the object or the ufo door state of the part changes.
+ * @param part the part number
+ */
+void Tile::updateBlockage(int part)
+{
+	for (int type = 0; type <= DT_SMOKE; ++type)
+	{
+		int block = 0;
+		// open ufo doors are actually still closed behind the scenes, but they obviously don't block anything
+		if (_objects[part] && !isUfoDoorOpen(part))
+		{
+			block = _objects[part]->getBlock((ItemDamageType)type);
+		}
+		_blockage[part][type] = block;
+	}
+	for (int movementType = 0; movementType <= MT_SLIDE; ++movementType)
+	{
+		_tuCost[part][movementType] = _objects[part] ? _objects[part]->getTUCost((MovementType)movementType) : 0;
+	}
 }
 
 /**
@@ -155,10 +181,18 @@ bool Tile::isVoid() const
  */
 int Tile::getTUCost(int part, MovementType movementType) const
 {
-	if (_objects[part])
-		return _objects[part]->getTUCost(movementType);
-	else
-		return 0;
+	return _tuCost[part][movementType];
+}
+
+/**
+ * Get the amount a part of the tile blocks a certain type of damage, light or vision.
+ * @param part the part 0-3.
+ * @param type the type of damage.
+ * @return amount of blockage
+ */
+int Tile::getBlockage(int part, ItemDamageType type) const
+{
+	return _blockage[part][type];
 }
 
 /**
@@ -247,6 +281,8 @@ int Tile::openDoor(int part)
 	if (_objects[part]->isUFODoor() && _currentFrame[part] == 0) // ufo door part 0 - door is closed
 	{
 		_currentFrame[part] = 1; // start opening door
+		updateBlockage(part);
+		_invalid = true;
 		return 1;
 	}
 	if (_objects[part]->isUFODoor() && _currentFrame[part] != 7) // ufo door != part 7 - door is still opening
@@ -280,6 +316,8 @@ int Tile::closeUfoDoor()
 		if (isUfoDoorOpen(part))
 		{
 			_currentFrame[part] = 0;
+			updateBlockage(part);
+			_invalid = true;
 			retval = 1;
 		}
 	}
@@ -302,6 +340,7 @@ void Tile::setDiscovered(bool flag, int part)
 			_discovered[0] = true;
 			_discovered[1] = true;
 		}
+		_invalid = true;
 		// if light on tile changes, units and objects on it change light too
 		if (_unit != 0)
 		{
@@ -322,24 +361,17 @@ bool Tile::isDiscovered(int part) const
 
 
 /**
- * Reset the light amount on the tile. This is done before a light level recalculation.
- * @param layer Light is separated in 3 layers: Ambient, Static and Dynamic.
- */
-void Tile::resetLight(int layer)
-{
-	_light[layer] = 0;
-	_lastLight[layer] = _light[layer];
-}
-
-/**
- * Add the light amount on the tile. Only add light if the current light is lower.
- * @param light Amount of light to add.
+ * Set the light amount on the tile.
+ * @param light Amount of light.
  * @param layer Light is separated in 3 layers: Ambient, Static and Dynamic.
  */
-void Tile::addLight(int light, int layer)
+void Tile::setLight(int light, int layer)
 {
-	if (_light[layer] < light)
+	if (_light[layer] != light)
+	{
 		_light[layer] = light;
+		_invalid = true;
+	}
 }
 
 /**
@@ -530,6 +562,11 @@ void Tile::animate()
 			{
 				newframe = 0;
 			}
+			// most objects show the same sprite on every frame, those don't need a redraw
+			if (_objects[i]->getSprite(newframe) != _objects[i]->getSprite(_currentFrame[i]))
+			{
+				_invalid = true;
+			}
 			_currentFrame[i] = newframe;
 		}
 	}
@@ -558,6 +595,13 @@ void Tile::setUnit(BattleUnit *unit)
 	{
 		unit->setTile(this);
 	}
+	if (_unit != unit)
+	{
+		_invalid = true;
+		// the battle is told through the grid of the unit that came or went
+		UnitGrid *grid = (unit ? unit : _unit)->getUnitGrid();
+		if (grid) grid->occupancyChanged();
+	}
 	_unit = unit;
 }
 
@@ -578,6 +622,7 @@ void Tile::setFire(int fire)
 {
 	_fire = fire;
 	_animationOffset = RNG::generate(0,3);
+	_invalid = true;
 }
 
 /**
@@ -598,6 +643,7 @@ void Tile::addSmoke(int smoke)
 	_smoke += smoke;
 	if (_smoke > 40) _smoke = 40;
 	_animationOffset = RNG::generate(0,3);
+	_invalid = true;
 }
 
 /**
@@ -629,6 +675,7 @@ void Tile::addItem(BattleItem *item, RuleInventory *ground)
 	item->setSlot(ground);
 	_inventory.push_back(item);
 	item->setTile(this);
+	_invalid = true;
 }
 
 /**
@@ -646,6 +693,7 @@ void Tile::removeItem(BattleItem *item)
 		}
 	}
 	item->setTile(0);
+	_invalid = true;
 }
 
 /**
@@ -672,6 +720,10 @@ int Tile::getTopItemSprite()
  */
 void Tile::prepareNewTurn()
 {
+	if (_smoke || _fire)
+	{
+		_invalid = true;
+	}
 	_smoke--;
 	if (_smoke < 0) _smoke = 0;
 
@@ -720,7 +772,11 @@ std::vector<BattleItem *> *Tile::getInventory()
  */
 void Tile::setMarkerColor(int color)
 {
-	_markerColor = color;
+	if (_markerColor != color)
+	{
+		_markerColor = color;
+		_invalid = true;
+	}
 }
 
 /**
@@ -748,4 +804,29 @@ int Tile::getVisible()
 	return _visible;
 }
 
+/**
+ * Mark the tile as changed, so the map redraws the part of the screen it covers.
+ */
+void Tile::invalidate()
+{
+	_invalid = true;
+}
+
+/**
+ * Check if anything drawn on the tile changed since the map last drew it.
+ * @return True if the tile needs to be redrawn.
+ */
+bool Tile::isInvalid() const
+{
+	return _invalid;
+}
+
+/**
+ * Mark the tile as drawn.
+ */
+void Tile::validate()
+{
+	_invalid = false;
+}
+
 }
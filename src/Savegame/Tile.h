@@ -41,14 +41,17 @@ class RuleInventory;
  */
 class Tile
 {
-protected:
+public:
 	static const int LIGHTLAYERS = 3;
+protected:
 	MapData *_objects[4];
 	int _mapDataID[4];
 	int _mapDataSetID[4];
 	int _currentFrame[4];
+	unsigned char _blockage[4][DT_SMOKE + 1];
+	int _tuCost[4][MT_SLIDE + 1];
 	bool _discovered[3];
-	int _light[LIGHTLAYERS], _lastLight[LIGHTLAYERS];
+	int _light[LIGHTLAYERS];
 	int _smoke;
 	int _fire;
 	int _explosive;
@@ -58,6 +61,8 @@ protected:
 	int _animationOffset;
 	int _markerColor;
 	int _visible;
+	bool _invalid;
+	void updateBlockage(int part);
 public:
 	/// Creates a tile.
 	Tile(const Position& pos);
@@ -77,6 +82,8 @@ public:
 	bool isVoid() const;
 	/// Get the TU cost to walk over a certain part of the tile.
 	int getTUCost(int part, MovementType movementType) const;
+	/// Get the amount a certain part of the tile blocks a type of damage.
+	int getBlockage(int part, ItemDamageType type) const;
 	/// Checks if this tile has a floor.
 	bool hasNoFloor() const;
 	/// Checks if this tile is a big wall.
@@ -97,10 +104,8 @@ public:
 	void setDiscovered(bool flag, int part);
 	/// Gets the black fog of war status of this tile.
 	bool isDiscovered(int part) const;
-	/// Reset light to zero for this tile.
-	void resetLight(int layer);
-	/// Add light to this tile.
-	void addLight(int light, int layer);
+	/// Set the light of this tile.
+	void setLight(int light, int layer);
 	/// Get the shade amount.
 	int getShade() const;
 	/// Destroy a tile part.
@@ -153,6 +158,12 @@ public:
 	void setVisible(int visibility);
 	/// Get the tile visible flag.
 	int getVisible();
+	/// Mark the tile as changed, so the map redraws it.
+	void invalidate();
+	/// Check if the tile changed since the map last drew it.
+	bool isInvalid() const;
+	/// Mark the tile as drawn.
+	void validate();
 
 };
 
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include "UnitGrid.h"
+#include "BattleUnit.h"
+
+namespace OpenXcom
+{
+
+/**
+ * Sets up an empty unit grid.
+ * @param mapWidth Width of the map in tiles.
+ * @param mapLength Length of the map in tiles.
+ * @param units Pointer to the unit list of the battle.
+ */
+UnitGrid::UnitGrid(int mapWidth, int mapLength, std::vector<BattleUnit*> *units) : _units(units), _registered(0), _occupancyVersion(0)
+{
+	_width = (mapWidth + CELL_SIZE - 1) / CELL_SIZE;
+	_length = (mapLength + CELL_SIZE - 1) / CELL_SIZE;
+	if (_width < 1) _width = 1;
+	if (_length < 1) _length = 1;
+	_cells.resize(_width * _length);
+}
+
+/**
+ * Deletes the unit grid.
+ */
+UnitGrid::~UnitGrid()
+{
+
+}
+
+/**
+ * Gets the cell a position falls in. Positions off the map are kept in the nearest cell.
+ * @param position Tile position.
+ * @return Cell index.
+ */
+int UnitGrid::getCell(const Position &position) const
+{
+	int x = std::max(0, std::min(position.x / CELL_SIZE, _width - 1));
+	int y = std::max(0, std::min(position.y / CELL_SIZE, _length - 1));
+	return y * _width + x;
+}
+
+/**
+ * Registers the units that were added to the battle since the last update.
+ * Units are never removed from a battle, so it's enough to look at the end of the list.
+ */
+void UnitGrid::update()
+{
+	if (_registered < _units->size())
+	{
+		// units that aren't registered yet couldn't report the tiles they went on
+		_occupancyVersion++;
+	}
+	for (; _registered < _units->size(); ++_registered)
+	{
+		BattleUnit *unit = _units->at(_registered);
+		_cells[getCell(unit->getPosition())].push_back(std::make_pair(_registered, unit));
+		unit->setUnitGrid(this);
+	}
+}
+
+/**
+ * Moves a unit to the cell of its new position.
+ * @param unit The unit that moved.
+ * @param from The position it came from.
+ */
+void UnitGrid::moveUnit(BattleUnit *unit, const Position &from)
+{
+	int oldCell = getCell(from), newCell = getCell(unit->getPosition());
+	if (oldCell == newCell)
+		return;
+
+	std::vector<std::pair<size_t, BattleUnit*> > &cell = _cells[oldCell];
+	for (std::vector<std::pair<size_t, BattleUnit*> >::iterator i = cell.begin(); i != cell.end(); ++i)
+	{
+		if (i->second == unit)
+		{
+			_cells[newCell].push_back(*i);
+			cell.erase(i);
+			return;
+		}
+	}
+}
+
+/**
+ * Notes that a unit went on or off a tile, when it walked, died or was converted.
+ */
+void UnitGrid::occupancyChanged()
+{
+	_occupancyVersion++;
+}
+
+/**
+ * Gets a number that changes whenever a unit goes on or off a tile or joins the battle,
+ * so results that depend on where units stand can tell they're out of date.
+ * @return The version.
+ */
+unsigned int UnitGrid::getOccupancyVersion()
+{
+	update();
+	return _occupancyVersion;
+}
+
+/**
+ * Gets the units within a distance of a position, in the order of the unit list.
+ * The distance is measured along each axis, so callers still have to apply their own
+ * distance check on the result, which never misses a unit within the radius.
+ * @param center The position to look around.
+ * @param radius The distance to look at.
+ * @param result Receives the units found.
+ */
+void UnitGrid::getUnits(const Position &center, int radius, std::vector<BattleUnit*> *result)
+{
+	update();
+
+	std::vector<std::pair<size_t, BattleUnit*> > found;
+	int x0 = getCell(Position(center.x - radius, 0, 0)) % _width;
+	int x1 = getCell(Position(center.x + radius, 0, 0)) % _width;
+	int y0 = getCell(Position(0, center.y - radius, 0)) / _width;
+	int y1 = getCell(Position(0, center.y + radius, 0)) / _width;
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			std::vector<std::pair<size_t, BattleUnit*> > &cell = _cells[y * _width + x];
+			for (std::vector<std::pair<size_t, BattleUnit*> >::iterator i = cell.begin(); i != cell.end(); ++i)
+			{
+				const Position &pos = i->second->getPosition();
+				if (abs(pos.x - center.x) <= radius && abs(pos.y - center.y) <= radius)
+				{
+					found.push_back(*i);
+				}
+			}
+		}
+	}
+
+	std::sort(found.begin(), found.end());
+	result->clear();
+	for (std::vector<std::pair<size_t, BattleUnit*> >::iterator i = found.begin(); i != found.end(); ++i)
+	{
+		result->push_back(i->second);
+	}
+}
+
+}
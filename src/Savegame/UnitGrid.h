@@ -0,0 +1,68 @@
+/*
+ * Copyright 2010-2012 OpenXcom Developers.
+ *
+ * This file is part of OpenXcom.
+ *
+ * OpenXcom is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * OpenXcom is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenXcom.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OPENXCOM_UNITGRID_H
+#define OPENXCOM_UNITGRID_H
+
+#include <vector>
+#include <utility>
+#include "../Battlescape/Position.h"
+
+namespace OpenXcom
+{
+
+class BattleUnit;
+
+/**
+ * Buckets the units of a battle by map area, so units near a position can be found
+ * without going through all of them. Units register themselves the first time the grid
+ * is queried after they were added to the battle, and report their moves from then on.
+ * Tiles report units going on or off them, so the grid knows when where units stand changed.
+ */
+class UnitGrid
+{
+private:
+	static const int CELL_SIZE = 10;
+	int _width, _length;
+	std::vector<BattleUnit*> *_units;
+	size_t _registered;
+	/// Counts the times a unit went on or off a tile or joined the battle.
+	unsigned int _occupancyVersion;
+	/// Units in each cell, paired with their place in the unit list.
+	std::vector<std::vector<std::pair<size_t, BattleUnit*> > > _cells;
+	int getCell(const Position &position) const;
+public:
+	/// Creates a unit grid for a map.
+	UnitGrid(int mapWidth, int mapLength, std::vector<BattleUnit*> *units);
+	/// Cleans up the unit grid.
+	~UnitGrid();
+	/// Registers the units added to the battle.
+	void update();
+	/// Moves a unit to the cell of its new position.
+	void moveUnit(BattleUnit *unit, const Position &from);
+	/// Notes that a unit went on or off a tile.
+	void occupancyChanged();
+	/// Gets a number that changes whenever a unit goes on or off a tile.
+	unsigned int getOccupancyVersion();
+	/// Gets the units within a distance of a position.
+	void getUnits(const Position &center, int radius, std::vector<BattleUnit*> *result);
+};
+
+}
+
+#endif